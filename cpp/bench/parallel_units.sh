@@ -0,0 +1,50 @@
+#!/bin/sh
+# Wall time of compiling many independent units with one job and with
+# several, to see how `-jN` scales.
+# usage: parallel_units.sh compiler [units] [jobs] [depth]
+#   units  number of generated sources, 64 by default
+#   jobs   job count to compare with -j1, all cores by default
+#   depth  nesting of the expression in each unit, which sets its size
+set -e
+compiler=$1
+units=${2:-64}
+jobs=${3:-$(getconf _NPROCESSORS_ONLN)}
+depth=${4:-20000}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+mkdir "$tmp/src" "$tmp/out"
+
+i=0
+while [ "$i" -lt "$units" ]; do
+  awk -v depth="$depth" -v seed="$i" 'BEGIN {
+    printf "int main() {\n  return "
+    for (j = 0; j < depth; j++) printf "%s(", substr("-+!", (j + seed) % 3 + 1, 1)
+    printf "%d", seed
+    for (j = 0; j < depth; j++) printf ")"
+    printf ";\n}\n"
+  }' > "$tmp/src/unit$i.c"
+  i=$((i + 1))
+done
+
+now_ms() {
+  echo $(($(date +%s%N) / 1000000))
+}
+
+# Milliseconds one compilation of all units takes with `-j$1`
+run() {
+  rm -f "$tmp"/out/*
+  start=$(now_ms)
+  "$compiler" -riscv "$tmp"/src/*.c -o "$tmp/out" -j"$1"
+  echo $(($(now_ms) - start))
+}
+
+# Warm the page cache and the binary first
+run "$jobs" > /dev/null
+serial=$(run 1)
+parallel=$(run "$jobs")
+echo "$units units of depth $depth"
+printf '%-8s%8d ms\n' "-j1:" "$serial" "-j$jobs:" "$parallel"
+awk -v s="$serial" -v p="$parallel" -v j="$jobs" 'BEGIN {
+  if (p > 0) printf "speedup: %.2fx on %d jobs\n", s / p, j
+}'
@@ -0,0 +1,21 @@
+#include "compile_client.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+// Takes the same command line as `compiler`, but leaves all the work to the
+// compile server named by `COMPILER_SERVER`. It links nothing of the
+// compiler, so starting it costs next to nothing.
+int main(int argc, const char *argv[]) {
+  const char *server = std::getenv("COMPILER_SERVER");
+  if (!server) {
+    std::fprintf(stderr, "error: COMPILER_SERVER is not set\n");
+    return 1;
+  }
+
+  int status = forward_to_server(server, argc, argv);
+  if (status < 0) {
+    std::fprintf(stderr, "error: no compile server on %s\n", server);
+    return 1;
+  }
+  return status;
+}
@@ -0,0 +1,38 @@
+#include "arena.hpp"
+#include <cstdint>
+#include <cstring>
+
+void Arena::grow(std::size_t min_size) {
+  std::size_t size = chunk_size;
+  while (size < min_size)
+    size *= 2;
+
+  // Deliberately not value-initialised, unlike `std::make_unique<char[]>`
+  chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+  reserved_bytes += size;
+  cur = chunks.back().get();
+  end = cur + size;
+}
+
+void *Arena::Allocate(std::size_t size, std::size_t align) {
+  auto addr = reinterpret_cast<std::uintptr_t>(cur);
+  std::size_t padding = (align - addr % align) % align;
+
+  if (cur == nullptr || padding + size > static_cast<std::size_t>(end - cur)) {
+    grow(size + align);
+    addr = reinterpret_cast<std::uintptr_t>(cur);
+    padding = (align - addr % align) % align;
+  }
+
+  char *ret = cur + padding;
+  cur = ret + size;
+  return ret;
+}
+
+const char *Arena::CopyString(std::string_view str) {
+  auto *ret = static_cast<char *>(Allocate(str.size() + 1, 1));
+  std::memcpy(ret, str.data(), str.size());
+  ret[str.size()] = '\0';
+  return ret;
+}
+
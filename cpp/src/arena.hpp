@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A bump-pointer allocator. Everything allocated from an arena is released at
+// once when the arena is destroyed, so only trivially destructible objects may
+// live in it.
+class Arena {
+private:
+  static constexpr std::size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *cur = nullptr;
+  char *end = nullptr;
+  std::size_t chunk_size;
+  std::size_t reserved_bytes = 0;
+
+  void grow(std::size_t min_size);
+
+public:
+  explicit Arena(std::size_t chunk_size_ = DEFAULT_CHUNK_SIZE)
+      : chunk_size(chunk_size_) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(std::size_t size, std::size_t align);
+
+  template <class T, class... Args> T *New(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena objects are never destroyed individually");
+    return new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Value-initialised array of `n` elements
+  template <class T> T *NewArray(std::size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena objects are never destroyed individually");
+    if (n == 0)
+      return nullptr;
+    return new (Allocate(sizeof(T) * n, alignof(T))) T[n]();
+  }
+
+  // Copies the string into the arena with a trailing NUL
+  const char *CopyString(std::string_view str);
+
+  // Total bytes reserved from the system so far
+  std::size_t reserved() const { return reserved_bytes; }
+};
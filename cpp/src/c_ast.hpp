@@ -1,7 +1,9 @@
 #pragma once
 
-#include <iostream>
-#include <memory>
+#include "emitter.hpp"
+#include <cstdint>
+#include <string_view>
+#include <vector>
 
 namespace c_ast {
 
@@ -20,141 +22,396 @@ inline const char *ToString(UnaryOp op) {
   }
 }
 
+// Tag of every concrete node type. Passes dispatch on this instead of RTTI,
+// see `ast_cast` and `ASTVisitor` below.
+enum class ASTKind : std::uint8_t {
+  CompUnit,
+  FuncDef,
+  FuncType,
+  Block,
+  Stmt,
+  Exp,
+  PrimaryExp,
+  PrimaryNumber,
+  Number,
+  UnaryExpPrimary,
+  UnaryExpOpUnary,
+};
+
+// All nodes are allocated from the translation unit's `Arena` and are never
+// destroyed individually, so they must stay trivially destructible: children
+// are plain pointers into the same arena and strings are views of arena text.
 class BaseAST {
 public:
-  virtual ~BaseAST() = default;
+  const ASTKind kind;
+
+  // Debug dumps of the subtree, see `DumpVisitor` and `JsonDumpVisitor`
+  void Dump(Emitter &out) const;
+  void DumpJson(Emitter &out) const;
 
-  virtual void Dump() const = 0;
+protected:
+  explicit BaseAST(ASTKind kind_) : kind(kind_) {}
+  ~BaseAST() = default;
 };
 
 class CompUnitAST final : public BaseAST {
 public:
-  std::unique_ptr<BaseAST> func_def;
+  static constexpr ASTKind KIND = ASTKind::CompUnit;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "CompUnitAST { ";
-    func_def->Dump();
-    std::cout << "}";
-  }
+  BaseAST *func_def = nullptr;
+
+  CompUnitAST() : BaseAST(KIND) {}
 };
 
 class FuncDefAST final : public BaseAST {
 public:
-  std::unique_ptr<BaseAST> func_type;
-  std::string ident;
-  std::unique_ptr<BaseAST> block;
+  static constexpr ASTKind KIND = ASTKind::FuncDef;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "FuncDefAST { ";
-    func_type->Dump();
-    std::cout << ", " << ident << ", ";
-    block->Dump();
-    std::cout << " }";
-  }
+  BaseAST *func_type = nullptr;
+  std::string_view ident;
+  BaseAST *block = nullptr;
+
+  FuncDefAST() : BaseAST(KIND) {}
 };
 
-class FuncTypeAST : public BaseAST {
+class FuncTypeAST final : public BaseAST {
 public:
-  void Dump() const override {
-    std::cout << "FuncTypeAST { ";
-    std::cout << "int";
-    std::cout << " }";
-  }
+  static constexpr ASTKind KIND = ASTKind::FuncType;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
+
+  FuncTypeAST() : BaseAST(KIND) {}
 };
 
 class BlockAST final : public BaseAST {
 public:
-  std::unique_ptr<BaseAST> stmt;
+  static constexpr ASTKind KIND = ASTKind::Block;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "BlockAST { ";
-    stmt->Dump();
-    std::cout << " }";
-  }
+  BaseAST *stmt = nullptr;
+
+  BlockAST() : BaseAST(KIND) {}
 };
 
 class StmtAST final : public BaseAST {
 public:
-  std::unique_ptr<BaseAST> exp;
+  static constexpr ASTKind KIND = ASTKind::Stmt;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "StmtAST { ";
-    exp->Dump();
-    std::cout << " }";
-  }
+  BaseAST *exp = nullptr;
+
+  StmtAST() : BaseAST(KIND) {}
 };
 
 class ExpAST final : public BaseAST {
 public:
-  std::unique_ptr<BaseAST> unary_exp;
+  static constexpr ASTKind KIND = ASTKind::Exp;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "ExpAST { ";
-    unary_exp->Dump();
-    std::cout << " }";
-  }
+  BaseAST *unary_exp = nullptr;
+
+  ExpAST() : BaseAST(KIND) {}
 };
 
 class PrimaryAST : public BaseAST {
 public:
-  virtual ~PrimaryAST() = default;
+  static bool classof(const BaseAST &node) {
+    return node.kind == ASTKind::PrimaryExp ||
+           node.kind == ASTKind::PrimaryNumber;
+  }
+
+protected:
+  using BaseAST::BaseAST;
 };
 
 class PrimaryASTExp final : public PrimaryAST {
 public:
-  std::unique_ptr<BaseAST> exp;
+  static constexpr ASTKind KIND = ASTKind::PrimaryExp;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "PrimaryAST { ";
-    exp->Dump();
-    std::cout << " }";
-  }
+  BaseAST *exp = nullptr;
+
+  PrimaryASTExp() : PrimaryAST(KIND) {}
 };
 
 class PrimaryASTNumber final : public PrimaryAST {
 public:
-  std::unique_ptr<BaseAST> number;
+  static constexpr ASTKind KIND = ASTKind::PrimaryNumber;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "PrimaryAST { ";
-    number->Dump();
-    std::cout << " }";
-  }
+  BaseAST *number = nullptr;
+
+  PrimaryASTNumber() : PrimaryAST(KIND) {}
 };
 
 class NumberAST final : public BaseAST {
 public:
+  static constexpr ASTKind KIND = ASTKind::Number;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
+
   int int_val;
 
-  void Dump() const override { std::cout << "Number { " << int_val << " }"; }
+  NumberAST() : BaseAST(KIND) {}
 };
 
 class UnaryExpAST : public BaseAST {
 public:
-  virtual ~UnaryExpAST() = default;
+  static bool classof(const BaseAST &node) {
+    return node.kind == ASTKind::UnaryExpPrimary ||
+           node.kind == ASTKind::UnaryExpOpUnary;
+  }
+
+protected:
+  using BaseAST::BaseAST;
 };
 
 class UnaryExpASTPrimary final : public UnaryExpAST {
 public:
-  std::unique_ptr<BaseAST> primary_exp;
+  static constexpr ASTKind KIND = ASTKind::UnaryExpPrimary;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
 
-  void Dump() const override {
-    std::cout << "UnaryExpAST { ";
-    primary_exp->Dump();
-    std::cout << " }";
-  }
+  BaseAST *primary_exp = nullptr;
+
+  UnaryExpASTPrimary() : UnaryExpAST(KIND) {}
 };
 
 class UnaryExpASTOpUnary final : public UnaryExpAST {
 public:
+  static constexpr ASTKind KIND = ASTKind::UnaryExpOpUnary;
+  static bool classof(const BaseAST &node) { return node.kind == KIND; }
+
   UnaryOp unary_op;
-  std::unique_ptr<BaseAST> unary_exp;
+  BaseAST *unary_exp = nullptr;
+
+  UnaryExpASTOpUnary() : UnaryExpAST(KIND) {}
+};
+
+// Checked downcast on the kind tag, returns nullptr on mismatch (or null input)
+template <class T> const T *ast_cast(const BaseAST *node) {
+  if (node && T::classof(*node))
+    return static_cast<const T *>(node);
+  return nullptr;
+}
 
-  void Dump() const override {
-    std::cout << "UnaryExpAST { " << ToString(unary_op) << "( ";
-    unary_exp->Dump();
-    std::cout << " ) }";
+// Dispatches on the kind tag to `Derived::Visit(const XxxAST &)`. A derived
+// visitor that only cares about some node types can add a catch-all
+// `Visit(const BaseAST &)` overload for the rest.
+template <class Derived, class R = void> class ASTVisitor {
+public:
+  R Dispatch(const BaseAST &node) {
+    auto &self = static_cast<Derived &>(*this);
+    switch (node.kind) {
+    case ASTKind::CompUnit:
+      return self.Visit(static_cast<const CompUnitAST &>(node));
+    case ASTKind::FuncDef:
+      return self.Visit(static_cast<const FuncDefAST &>(node));
+    case ASTKind::FuncType:
+      return self.Visit(static_cast<const FuncTypeAST &>(node));
+    case ASTKind::Block:
+      return self.Visit(static_cast<const BlockAST &>(node));
+    case ASTKind::Stmt:
+      return self.Visit(static_cast<const StmtAST &>(node));
+    case ASTKind::Exp:
+      return self.Visit(static_cast<const ExpAST &>(node));
+    case ASTKind::PrimaryExp:
+      return self.Visit(static_cast<const PrimaryASTExp &>(node));
+    case ASTKind::PrimaryNumber:
+      return self.Visit(static_cast<const PrimaryASTNumber &>(node));
+    case ASTKind::Number:
+      return self.Visit(static_cast<const NumberAST &>(node));
+    case ASTKind::UnaryExpPrimary:
+      return self.Visit(static_cast<const UnaryExpASTPrimary &>(node));
+    case ASTKind::UnaryExpOpUnary:
+      return self.Visit(static_cast<const UnaryExpASTOpUnary &>(node));
+    }
+    __builtin_unreachable();
   }
 };
 
+// Prints the tree with an explicit work list rather than recursion, so
+// arbitrarily deep expressions cannot overflow the native stack. Each visit
+// prints the node's opening text and schedules its children and closing text.
+template <class Derived> class WorkListDumper : public ASTVisitor<Derived> {
+private:
+  // Either a node still to be visited or literal text to print
+  struct WorkItem {
+    const BaseAST *node;
+    std::string_view text;
+  };
+
+  std::vector<WorkItem> work;
+
+protected:
+  Emitter &out;
+
+  void Schedule(const BaseAST *node) { work.push_back({node, {}}); }
+  void Schedule(std::string_view text) { work.push_back({nullptr, text}); }
+
+public:
+  explicit WorkListDumper(Emitter &out_) : out(out_) {}
+
+  void Run(const BaseAST &root) {
+    Schedule(&root);
+    while (!work.empty()) {
+      WorkItem item = work.back();
+      work.pop_back();
+      if (item.node)
+        this->Dispatch(*item.node);
+      else
+        out << item.text;
+    }
+  }
+};
+
+// Human-readable nested form, `CompUnitAST { FuncDefAST { ... } }`
+class DumpVisitor : public WorkListDumper<DumpVisitor> {
+public:
+  using WorkListDumper::WorkListDumper;
+
+  // Children and text are scheduled in reverse order of printing
+  void Visit(const CompUnitAST &node) {
+    out << "CompUnitAST { ";
+    Schedule("}");
+    Schedule(node.func_def);
+  }
+
+  void Visit(const FuncDefAST &node) {
+    out << "FuncDefAST { ";
+    Schedule(" }");
+    Schedule(node.block);
+    Schedule(", ");
+    Schedule(node.ident);
+    Schedule(", ");
+    Schedule(node.func_type);
+  }
+
+  void Visit(const FuncTypeAST &) { out << "FuncTypeAST { int }"; }
+
+  void Visit(const BlockAST &node) {
+    out << "BlockAST { ";
+    Schedule(" }");
+    Schedule(node.stmt);
+  }
+
+  void Visit(const StmtAST &node) {
+    out << "StmtAST { ";
+    Schedule(" }");
+    Schedule(node.exp);
+  }
+
+  void Visit(const ExpAST &node) {
+    out << "ExpAST { ";
+    Schedule(" }");
+    Schedule(node.unary_exp);
+  }
+
+  void Visit(const PrimaryASTExp &node) {
+    out << "PrimaryAST { ";
+    Schedule(" }");
+    Schedule(node.exp);
+  }
+
+  void Visit(const PrimaryASTNumber &node) {
+    out << "PrimaryAST { ";
+    Schedule(" }");
+    Schedule(node.number);
+  }
+
+  void Visit(const NumberAST &node) {
+    out << "Number { " << node.int_val << " }";
+  }
+
+  void Visit(const UnaryExpASTPrimary &node) {
+    out << "UnaryExpAST { ";
+    Schedule(" }");
+    Schedule(node.primary_exp);
+  }
+
+  void Visit(const UnaryExpASTOpUnary &node) {
+    out << "UnaryExpAST { " << ToString(node.unary_op) << "( ";
+    Schedule(" ) }");
+    Schedule(node.unary_exp);
+  }
+};
+
+// One JSON object per node, `{"kind": "...", <field>: <child>, ...}`, for
+// tools. Identifiers never need escaping.
+class JsonDumpVisitor : public WorkListDumper<JsonDumpVisitor> {
+public:
+  using WorkListDumper::WorkListDumper;
+
+  void Visit(const CompUnitAST &node) {
+    out << "{\"kind\":\"CompUnit\",\"func_def\":";
+    Schedule("}");
+    Schedule(node.func_def);
+  }
+
+  void Visit(const FuncDefAST &node) {
+    out << "{\"kind\":\"FuncDef\",\"ident\":\"" << node.ident
+        << "\",\"func_type\":";
+    Schedule("}");
+    Schedule(node.block);
+    Schedule(",\"block\":");
+    Schedule(node.func_type);
+  }
+
+  void Visit(const FuncTypeAST &) {
+    out << "{\"kind\":\"FuncType\",\"type\":\"int\"}";
+  }
+
+  void Visit(const BlockAST &node) {
+    out << "{\"kind\":\"Block\",\"stmt\":";
+    Schedule("}");
+    Schedule(node.stmt);
+  }
+
+  void Visit(const StmtAST &node) {
+    out << "{\"kind\":\"Stmt\",\"exp\":";
+    Schedule("}");
+    Schedule(node.exp);
+  }
+
+  void Visit(const ExpAST &node) {
+    out << "{\"kind\":\"Exp\",\"unary_exp\":";
+    Schedule("}");
+    Schedule(node.unary_exp);
+  }
+
+  void Visit(const PrimaryASTExp &node) {
+    out << "{\"kind\":\"PrimaryExp\",\"exp\":";
+    Schedule("}");
+    Schedule(node.exp);
+  }
+
+  void Visit(const PrimaryASTNumber &node) {
+    out << "{\"kind\":\"PrimaryNumber\",\"number\":";
+    Schedule("}");
+    Schedule(node.number);
+  }
+
+  void Visit(const NumberAST &node) {
+    out << "{\"kind\":\"Number\",\"value\":" << node.int_val << "}";
+  }
+
+  void Visit(const UnaryExpASTPrimary &node) {
+    out << "{\"kind\":\"UnaryExpPrimary\",\"primary_exp\":";
+    Schedule("}");
+    Schedule(node.primary_exp);
+  }
+
+  void Visit(const UnaryExpASTOpUnary &node) {
+    out << "{\"kind\":\"UnaryExpOpUnary\",\"op\":\""
+        << ToString(node.unary_op) << "\",\"unary_exp\":";
+    Schedule("}");
+    Schedule(node.unary_exp);
+  }
+};
+
+inline void BaseAST::Dump(Emitter &out) const { DumpVisitor(out).Run(*this); }
+
+inline void BaseAST::DumpJson(Emitter &out) const {
+  JsonDumpVisitor(out).Run(*this);
+}
+
 } // namespace c_ast
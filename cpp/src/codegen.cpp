@@ -1,28 +1,62 @@
 #include "codegen.hpp"
 #include "koopa.h"
 #include "logger.hpp"
+#include "peephole.hpp"
+#include "thread_pool.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <optional>
 #include <string_view>
 
-static constexpr const std::string_view INDENT = "\t";
 static constexpr const reg_t RETURN_REGISTER = reg_t{'a', 0};
 static constexpr const reg_t ZERO_REGISTER = reg_t{'x', 0};
+static constexpr const reg_t STACK_POINTER = reg_t{'x', 2};
+// `x1` is `ra`, it is only ever saved and restored by the prologue/epilogue
+static constexpr const reg_t RETURN_ADDRESS_REGISTER = reg_t{'x', 1};
 
-reg_t reallocate_register() {
-  LOG_ERROR("Insufficient registers (currently have no way to resolve.)");
+// Value of a constant operand
+static std::optional<std::int32_t> as_const(koopa_raw_value_t value) {
+  if (value->kind.tag != KOOPA_RVT_INTEGER) {
+    return std::nullopt;
+  }
+  return value->kind.data.integer.value;
 }
 
-void CodeGenUnit::generate(const koopa_raw_program_t &program) {
+MProgram CodeGenUnit::lower(const koopa_raw_program_t &program) {
+  mprogram.functions.clear();
   Visit(program);
+  return std::move(mprogram);
+}
+
+void CodeGenUnit::generate(const koopa_raw_program_t &program) {
+  lower(program).print(output);
+  output.flush();
 }
 
 void CodeGenUnit::Visit(const koopa_raw_program_t &program) {
   Visit(program.values);
-  // Mark the start of programs
-  output << INDENT << ".text" << std::endl
-         << INDENT << ".global main" << std::endl;
-  Visit(program.funcs);
+  if (jobs > 1 && program.funcs.len > 1) {
+    lower_functions_parallel(program.funcs);
+  } else {
+    Visit(program.funcs);
+  }
+}
+
+void CodeGenUnit::lower_functions_parallel(const koopa_raw_slice_t &funcs) {
+  mprogram.functions.resize(funcs.len);
+  WorkStealingPool pool(std::min<std::size_t>(jobs, funcs.len));
+  for (size_t i = 0; i < funcs.len; i++) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(funcs.buffer[i]);
+    pool.submit([this, func, &out = mprogram.functions[i]] {
+      CodeGenUnit worker(allocator);
+      worker.mfunc = &out;
+      worker.Visit(func);
+      peephole_removed += worker.peephole_removed;
+    });
+  }
+  pool.wait();
 }
 
 void CodeGenUnit::Visit(const koopa_raw_slice_t &slice) {
@@ -31,6 +65,7 @@ void CodeGenUnit::Visit(const koopa_raw_slice_t &slice) {
 
     switch (slice.kind) {
     case KOOPA_RSIK_FUNCTION:
+      mfunc = &mprogram.functions.emplace_back();
       Visit(reinterpret_cast<koopa_raw_function_t>(ptr));
       break;
     case KOOPA_RSIK_BASIC_BLOCK:
@@ -46,56 +81,155 @@ void CodeGenUnit::Visit(const koopa_raw_slice_t &slice) {
 }
 
 void CodeGenUnit::Visit(const koopa_raw_function_t &func) {
+  // Decide where every value lives before emitting anything, the frame size
+  // depends on it
+  ctx = std::make_unique<CodeGenCtx>(allocator->allocate(func));
+
   // Put the name (may need to add arguments later)
-  output << std::string_view(func->name).substr(1) << ":" << std::endl;
+  mfunc->name = std::string_view(func->name).substr(1);
+
+  // The prologue is a block of its own, which nothing branches to, so that
+  // every block of the body can be a branch target; Koopa block `i` is
+  // block `i + 1`
+  mfunc->blocks.push_back(MBlock{0, 0});
+  emit_prologue();
+  mfunc->blocks.back().end = static_cast<std::uint32_t>(mfunc->insts.size());
 
   // Visit the function body
   Visit(func->bbs);
+
+  // Backend passes
+  peephole_removed += run_peephole(*mfunc);
+  ctx.reset();
 }
 
 void CodeGenUnit::Visit(const koopa_raw_basic_block_t &basic_block) {
-  indent_level++;
+  auto start = static_cast<std::uint32_t>(mfunc->insts.size());
+  mfunc->blocks.push_back(MBlock{start, start});
 
   Visit(basic_block->insts);
 
-  indent_level--;
+  mfunc->blocks.back().end = static_cast<std::uint32_t>(mfunc->insts.size());
 }
 
-reg_t CodeGenUnit::Visit(const koopa_raw_value_t &value) {
-  // Check if we have seen the instruction before, avoid duplication
-  auto it = this->ctx->reg_dict.find(value);
-  if (it != this->ctx->reg_dict.end()) {
-    return it->second;
-  }
+void CodeGenUnit::Visit(const koopa_raw_value_t &value) {
+  // Scratch registers only live for the duration of one instruction
+  ctx->reset_scratch();
 
   const auto &kind = value->kind;
-  reg_t dst;
   switch (kind.tag) {
   case KOOPA_RVT_RETURN:
-    dst = Visit(kind.data.ret);
-    break;
-  case KOOPA_RVT_INTEGER:
-    dst = Visit(kind.data.integer);
+    Visit(kind.data.ret);
     break;
-  case KOOPA_RVT_BINARY:
-    dst = Visit(kind.data.binary);
+  case KOOPA_RVT_BINARY: {
+    reg_t dst = def_reg(value);
+    Visit(kind.data.binary, dst);
+    commit_def(value, dst);
     break;
+  }
   default:
     LOG_ERROR("Unexpected koopa instruction type.");
   }
+}
 
-  // Remember the variable name
-  this->ctx->reg_dict[value] = dst;
-  return dst;
+reg_t CodeGenUnit::use(koopa_raw_value_t value) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    return Visit(value->kind.data.integer);
+  }
+
+  const Location &loc = ctx->location(value);
+  if (loc.is_reg()) {
+    return loc.reg;
+  }
+
+  reg_t reg = ctx->take_scratch();
+  emit_sp_access(MOp::LW, reg, loc.offset);
+  return reg;
+}
+
+reg_t CodeGenUnit::def_reg(koopa_raw_value_t value) {
+  const Location &loc = ctx->location(value);
+  if (loc.is_reg()) {
+    return loc.reg;
+  }
+  // Instructions read all of their operands before writing the result, so
+  // the first scratch register can be reused even if an operand is in it
+  return reg_t{'t', 5};
+}
+
+void CodeGenUnit::commit_def(koopa_raw_value_t value, reg_t reg) {
+  const Location &loc = ctx->location(value);
+  if (!loc.is_reg()) {
+    emit_sp_access(MOp::SW, reg, loc.offset);
+  }
+}
+
+void CodeGenUnit::emit_sp_access(MOp op, reg_t reg, std::int32_t offset) {
+  reg_t base = STACK_POINTER;
+  if (!fits_imm12(offset)) {
+    // Compute the address in `t6`, which is free once operands are loaded
+    base = reg_t{'t', 6};
+    emit_li(base, offset);
+    emit_op(MOp::ADD, base, base, STACK_POINTER);
+    offset = 0;
+  }
+  if (op == MOp::SW) {
+    emit(MInst{op, MREG_ZERO, MReg::from(base), MReg::from(reg), offset});
+  } else {
+    emit(MInst{op, MReg::from(reg), MReg::from(base), MREG_ZERO, offset});
+  }
+}
+
+void CodeGenUnit::emit_sp_adjust(std::int32_t delta) {
+  if (fits_imm12(delta)) {
+    emit_op_imm(MOp::ADDI, STACK_POINTER, STACK_POINTER, delta);
+  } else {
+    emit_li(reg_t{'t', 6}, delta);
+    emit_op(MOp::ADD, STACK_POINTER, STACK_POINTER, reg_t{'t', 6});
+  }
+}
+
+void CodeGenUnit::emit_prologue() {
+  if (ctx->frame_size == 0) {
+    return;
+  }
+
+  emit_sp_adjust(-ctx->frame_size);
+  for (size_t i = 0; i < ctx->alloc.callee_saved.size(); i++) {
+    emit_sp_access(MOp::SW, ctx->alloc.callee_saved[i],
+                   ctx->callee_saved_offset(i));
+  }
+  if (ctx->alloc.has_calls) {
+    emit_sp_access(MOp::SW, RETURN_ADDRESS_REGISTER, ctx->ra_offset());
+  }
 }
 
-reg_t CodeGenUnit::Visit(const koopa_raw_return_t &ret) {
-  reg_t dst = Visit(ret.value);
-  if (dst != RETURN_REGISTER) {
-    output << INDENT << "mv    a0, " << dst.to_string() << std::endl;
+void CodeGenUnit::emit_epilogue() {
+  if (ctx->frame_size == 0) {
+    return;
   }
-  output << INDENT << "ret" << std::endl;
-  return reg_t{'a', 0};
+
+  for (size_t i = 0; i < ctx->alloc.callee_saved.size(); i++) {
+    emit_sp_access(MOp::LW, ctx->alloc.callee_saved[i],
+                   ctx->callee_saved_offset(i));
+  }
+  if (ctx->alloc.has_calls) {
+    emit_sp_access(MOp::LW, RETURN_ADDRESS_REGISTER, ctx->ra_offset());
+  }
+  emit_sp_adjust(ctx->frame_size);
+}
+
+void CodeGenUnit::Visit(const koopa_raw_return_t &ret) {
+  if (ret.value) {
+    if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
+      // Materialise constants straight into the return register
+      emit_li(RETURN_REGISTER, ret.value->kind.data.integer.value);
+    } else {
+      emit_mv(RETURN_REGISTER, use(ret.value));
+    }
+  }
+  emit_epilogue();
+  emit(MInst{MOp::RET});
 }
 
 reg_t CodeGenUnit::Visit(const koopa_raw_integer_t &num) {
@@ -104,70 +238,415 @@ reg_t CodeGenUnit::Visit(const koopa_raw_integer_t &num) {
     return ZERO_REGISTER;
   }
 
-  std::optional<reg_t> dst = this->ctx->get_avail();
-  if (dst) {
-    output << INDENT << "li    " << dst->to_string() << ", " << num.value
-           << std::endl;
-    return *dst;
+  reg_t dst = ctx->take_scratch();
+  emit_li(dst, num.value);
+  return dst;
+}
+
+void CodeGenUnit::emit_li(reg_t reg, std::int32_t value) {
+  if (fits_imm12(value)) {
+    emit(MInst{MOp::LI, MReg::from(reg), MREG_ZERO, MREG_ZERO, value});
+    return;
+  }
+
+  ImmSplit split = split_imm32(value);
+  emit(MInst{MOp::LUI, MReg::from(reg), MREG_ZERO, MREG_ZERO, split.hi});
+  if (split.lo != 0) {
+    emit_op_imm(MOp::ADDI, reg, reg, split.lo);
+  }
+}
+
+void CodeGenUnit::emit_mv(reg_t dst, reg_t src) {
+  if (dst != src) {
+    emit_op(MOp::MV, dst, src);
+  }
+}
+
+void CodeGenUnit::emit_op(MOp op, reg_t dst, reg_t src) {
+  emit(MInst{op, MReg::from(dst), MReg::from(src)});
+}
+
+void CodeGenUnit::emit_op(MOp op, reg_t dst, reg_t lhs, reg_t rhs) {
+  emit(MInst{op, MReg::from(dst), MReg::from(lhs), MReg::from(rhs)});
+}
+
+void CodeGenUnit::emit_op_imm(MOp op, reg_t dst, reg_t src, std::int32_t imm) {
+  emit(MInst{op, MReg::from(dst), MReg::from(src), MREG_ZERO, imm});
+}
+
+void CodeGenUnit::emit_alu(MOp rr_op, std::optional<MOp> ri_op,
+                           bool commutative, reg_t dst,
+                           koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+  if (commutative && as_const(lhs) && !as_const(rhs)) {
+    std::swap(lhs, rhs);
+  }
+  auto imm = as_const(rhs);
+  if (ri_op && imm && fits_imm12(*imm)) {
+    emit_op_imm(*ri_op, dst, use(lhs), *imm);
+    return;
+  }
+
+  reg_t l_reg = use(lhs);
+  reg_t r_reg = use(rhs);
+  emit_op(rr_op, dst, l_reg, r_reg);
+}
+
+// log2 of `value` if it is a power of two, -1 otherwise
+static int exact_log2(std::uint64_t value) {
+  if (value == 0 || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int k = 0;
+  while ((value >> k) != 1) {
+    k++;
+  }
+  return k;
+}
+
+// Multiplier and shift that turn signed division by `d` into a `mulh`, see
+// Hacker's Delight, 10-1. Needs `|d| >= 2`.
+struct DivMagic {
+  std::int32_t multiplier;
+  int shift;
+};
+
+static DivMagic signed_div_magic(std::int32_t d) {
+  const std::uint32_t two31 = 0x80000000u;
+  std::uint32_t ad = d < 0 ? 0u - static_cast<std::uint32_t>(d)
+                           : static_cast<std::uint32_t>(d);
+  std::uint32_t t = two31 + (static_cast<std::uint32_t>(d) >> 31);
+  std::uint32_t anc = t - 1 - t % ad;
+  int p = 31;
+  std::uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+  std::uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+  std::uint32_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+
+  std::uint32_t m = q2 + 1;
+  if (d < 0) {
+    m = 0u - m;
+  }
+  return {static_cast<std::int32_t>(m), p - 32};
+}
+
+void CodeGenUnit::emit_compare(koopa_raw_binary_op_t op, reg_t dst,
+                               koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+  auto lc = as_const(lhs);
+  auto rc = as_const(rhs);
+  switch (op) {
+  case KOOPA_RBO_EQ:
+  case KOOPA_RBO_NOT_EQ: {
+    // `x op c` as `(x ^ c) op 0`, with `x ^ 0` being `x` itself
+    MOp set = op == KOOPA_RBO_EQ ? MOp::SEQZ : MOp::SNEZ;
+    koopa_raw_value_t x = lhs;
+    auto c = rc;
+    if (lc && !rc) {
+      x = rhs;
+      c = lc;
+    }
+    if (c && *c == 0) {
+      emit_op(set, dst, use(x));
+      return;
+    }
+    emit_alu(MOp::XOR, MOp::XORI, true, dst, lhs, rhs);
+    emit_op(set, dst, dst);
+    return;
+  }
+  case KOOPA_RBO_LT:
+    emit_alu(MOp::SLT, MOp::SLTI, false, dst, lhs, rhs);
+    return;
+  case KOOPA_RBO_GT:
+    // `x > y` is `y < x`
+    emit_alu(MOp::SLT, MOp::SLTI, false, dst, rhs, lhs);
+    return;
+  case KOOPA_RBO_LE:
+    // `x <= c` is `x < c + 1`, otherwise `!(y < x)`
+    if (rc && !lc && fits_imm12(std::int64_t(*rc) + 1)) {
+      emit_op_imm(MOp::SLTI, dst, use(lhs), *rc + 1);
+      return;
+    }
+    emit_alu(MOp::SLT, MOp::SLTI, false, dst, rhs, lhs);
+    emit_op_imm(MOp::XORI, dst, dst, 1);
+    return;
+  case KOOPA_RBO_GE:
+    // `c >= y` is `y < c + 1`, otherwise `!(x < y)`
+    if (lc && !rc && fits_imm12(std::int64_t(*lc) + 1)) {
+      emit_op_imm(MOp::SLTI, dst, use(rhs), *lc + 1);
+      return;
+    }
+    emit_alu(MOp::SLT, MOp::SLTI, false, dst, lhs, rhs);
+    emit_op_imm(MOp::XORI, dst, dst, 1);
+    return;
+  default:
+    LOG_ERROR("Not a comparison.");
+  }
+}
+
+void CodeGenUnit::emit_shift(MOp rr_op, MOp ri_op, reg_t dst, koopa_raw_value_t lhs,
+                             koopa_raw_value_t rhs) {
+  // Only the low 5 bits of the amount count, as for the register forms
+  if (auto amount = as_const(rhs)) {
+    int shamt = *amount & 31;
+    if (shamt == 0) {
+      emit_mv(dst, use(lhs));
+    } else {
+      emit_op_imm(ri_op, dst, use(lhs), shamt);
+    }
+    return;
+  }
+  emit_alu(rr_op, std::nullopt, false, dst, lhs, rhs);
+}
+
+void CodeGenUnit::emit_mul(reg_t dst, koopa_raw_value_t lhs,
+                           koopa_raw_value_t rhs) {
+  if (as_const(lhs) && !as_const(rhs)) {
+    std::swap(lhs, rhs);
+  }
+  auto rc = as_const(rhs);
+  if (!rc) {
+    emit_alu(MOp::MUL, std::nullopt, true, dst, lhs, rhs);
+    return;
+  }
+
+  // `x * c` for `|c|` a power of two or next to one as shifts and an add
+  std::int32_t c = *rc;
+  std::int64_t mag = c < 0 ? -std::int64_t(c) : c;
+  if (c == 0) {
+    emit_li(dst, 0);
+    return;
+  }
+  reg_t x = use(lhs);
+  if (int k = exact_log2(mag); k >= 0) {
+    if (k == 0) {
+      emit_mv(dst, x);
+    } else {
+      emit_op_imm(MOp::SLLI, dst, x, k);
+    }
+    if (c < 0) {
+      emit_op(MOp::NEG, dst, dst);
+    }
+    return;
+  }
+  if (int k = exact_log2(mag - 1); k > 0) {
+    // 2^k * x + x
+    reg_t t = ctx->take_scratch();
+    emit_op_imm(MOp::SLLI, t, x, k);
+    emit_op(MOp::ADD, dst, t, x);
+    if (c < 0) {
+      emit_op(MOp::NEG, dst, dst);
+    }
+    return;
+  }
+  if (int k = exact_log2(mag + 1); k > 0) {
+    // 2^k * x - x, or x - 2^k * x for the negative constant
+    reg_t t = ctx->take_scratch();
+    emit_op_imm(MOp::SLLI, t, x, k);
+    if (c < 0) {
+      emit_op(MOp::SUB, dst, x, t);
+    } else {
+      emit_op(MOp::SUB, dst, t, x);
+    }
+    return;
+  }
+
+  reg_t t = ctx->take_scratch();
+  emit_li(t, c);
+  emit_op(MOp::MUL, dst, x, t);
+}
+
+void CodeGenUnit::emit_pow2_bias(reg_t t, reg_t x, int k) {
+  // `2^k - 1` for negative `x`, 0 otherwise
+  if (k == 1) {
+    emit_op_imm(MOp::SRLI, t, x, 31);
   } else {
-    reallocate_register();
+    emit_op_imm(MOp::SRAI, t, x, 31);
+    emit_op_imm(MOp::SRLI, t, t, 32 - k);
   }
+  emit_op(MOp::ADD, t, x, t);
 }
 
-reg_t CodeGenUnit::Visit(const koopa_raw_binary_t &binary) {
-  reg_t l_reg = Visit(binary.lhs);
-  reg_t r_reg = Visit(binary.rhs);
-  reg_t dst;
-  switch (binary.op) {
-  case KOOPA_RBO_EQ: {
-    // Reuse one of the register
-    if (l_reg != ZERO_REGISTER) {
-      dst = l_reg;
-    } else if (r_reg != ZERO_REGISTER) {
-      dst = r_reg;
+void CodeGenUnit::emit_magic_quotient(reg_t dst, reg_t t, reg_t sign,
+                                      reg_t x, std::int32_t d) {
+  DivMagic magic = signed_div_magic(d);
+  emit_li(t, magic.multiplier);
+  emit_op(MOp::MULH, t, x, t);
+  if (d > 0 && magic.multiplier < 0) {
+    emit_op(MOp::ADD, t, t, x);
+  } else if (d < 0 && magic.multiplier > 0) {
+    emit_op(MOp::SUB, t, t, x);
+  }
+  if (magic.shift > 0) {
+    emit_op_imm(MOp::SRAI, t, t, magic.shift);
+  }
+  // The quotient is rounded down, so a negative one is one too small
+  emit_op_imm(MOp::SRLI, sign, t, 31);
+  emit_op(MOp::ADD, dst, t, sign);
+}
+
+void CodeGenUnit::emit_div(reg_t dst, koopa_raw_value_t lhs,
+                           koopa_raw_value_t rhs) {
+  // Division by 0 and by INT32_MIN are left to the hardware
+  auto rc = as_const(rhs);
+  if (!rc || *rc == 0 || *rc == INT32_MIN) {
+    emit_alu(MOp::DIV, std::nullopt, false, dst, lhs, rhs);
+    return;
+  }
+
+  std::int32_t d = *rc;
+  reg_t x = use(lhs);
+  if (d == 1 || d == -1) {
+    if (d == 1) {
+      emit_mv(dst, x);
     } else {
-      std::optional<reg_t> dst_req = this->ctx->get_avail();
-      if (dst_req) {
-        dst = dst_req.value();
-      } else {
-        reallocate_register();
-      }
-    }
-
-    // XOR instruction
-    this->output << INDENT << "xor   " << dst.to_string() << ", "
-                 << l_reg.to_string() << ", " << r_reg.to_string() << std::endl;
-    // SEQZ instruction
-    this->output << INDENT << "seqz  " << dst.to_string() << ", "
-                 << dst.to_string() << std::endl;
-    return dst;
-    break;
+      emit_op(MOp::NEG, dst, x);
+    }
+    return;
   }
+
+  if (int k = exact_log2(d < 0 ? -std::int64_t(d) : d); k > 0) {
+    // Shifting rounds down, so negative dividends are biased first to round
+    // towards zero
+    reg_t t = ctx->take_scratch();
+    emit_pow2_bias(t, x, k);
+    emit_op_imm(MOp::SRAI, dst, t, k);
+    if (d < 0) {
+      emit_op(MOp::NEG, dst, dst);
+    }
+    return;
+  }
+
+  // `x` is not needed once the quotient is formed, so its scratch register
+  // may hold the sign
+  reg_t t = ctx->take_scratch();
+  reg_t sign = ctx->is_scratch(x) ? x : ctx->take_scratch();
+  emit_magic_quotient(dst, t, sign, x, d);
+}
+
+void CodeGenUnit::emit_rem(reg_t dst, koopa_raw_value_t lhs,
+                           koopa_raw_value_t rhs) {
+  auto rc = as_const(rhs);
+  if (!rc || *rc == 0 || *rc == INT32_MIN) {
+    emit_alu(MOp::REM, std::nullopt, false, dst, lhs, rhs);
+    return;
+  }
+
+  // The remainder takes the sign of the dividend, only `|d|` matters
+  std::int32_t d = *rc;
+  std::int64_t mag = d < 0 ? -std::int64_t(d) : d;
+  if (mag == 1) {
+    emit_li(dst, 0);
+    return;
+  }
+
+  reg_t x = use(lhs);
+  if (int k = exact_log2(mag); k > 0) {
+    // x - (x rounded towards zero to a multiple of 2^k)
+    reg_t t = ctx->take_scratch();
+    emit_pow2_bias(t, x, k);
+    if (fits_imm12(-mag)) {
+      emit_op_imm(MOp::ANDI, t, t, static_cast<std::int32_t>(-mag));
+    } else {
+      emit_op_imm(MOp::SRLI, t, t, k);
+      emit_op_imm(MOp::SLLI, t, t, k);
+    }
+    emit_op(MOp::SUB, dst, x, t);
+    return;
+  }
+
+  // x - (x / d) * d needs `x` until the end, and a loaded `x` leaves only
+  // one scratch register
+  if (ctx->is_scratch(x)) {
+    reg_t t = ctx->take_scratch();
+    emit_li(t, d);
+    emit_op(MOp::REM, dst, x, t);
+    return;
+  }
+  reg_t t = ctx->take_scratch();
+  reg_t u = ctx->take_scratch();
+  emit_magic_quotient(t, t, u, x, d);
+  emit_li(u, d);
+  emit_op(MOp::MUL, t, t, u);
+  emit_op(MOp::SUB, dst, x, t);
+}
+
+// Instruction selection: constant operands are folded into immediates where
+// the instruction has an immediate form, and the common special cases get
+// their one-operand idioms (`neg`, `not`, `seqz`, `snez`), so constants only
+// take a register when they do not fit. Multiplication and division by
+// constants avoid `mul`/`div`/`rem` where shifts or a `mulh` do.
+void CodeGenUnit::Visit(const koopa_raw_binary_t &binary, reg_t dst) {
+  auto lhs = as_const(binary.lhs);
+  auto rhs = as_const(binary.rhs);
+  switch (binary.op) {
+  case KOOPA_RBO_NOT_EQ:
+  case KOOPA_RBO_EQ:
+  case KOOPA_RBO_GT:
+  case KOOPA_RBO_LT:
+  case KOOPA_RBO_GE:
+  case KOOPA_RBO_LE:
+    emit_compare(binary.op, dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_ADD:
+    emit_alu(MOp::ADD, MOp::ADDI, true, dst, binary.lhs, binary.rhs);
+    break;
   case KOOPA_RBO_SUB: {
-    std::optional<reg_t> dst_req = this->ctx->get_avail();
-    if (dst_req) {
-      dst = dst_req.value();
+    if (lhs && *lhs == 0) {
+      emit_op(MOp::NEG, dst, use(binary.rhs));
+    } else if (rhs && fits_imm12(-std::int64_t(*rhs))) {
+      emit_op_imm(MOp::ADDI, dst, use(binary.lhs), -*rhs);
     } else {
-      reallocate_register();
+      emit_alu(MOp::SUB, std::nullopt, false, dst, binary.lhs, binary.rhs);
     }
-    this->output << INDENT << "sub   " << dst.to_string() << ", "
-                 << l_reg.to_string() << ", " << r_reg.to_string() << std::endl;
-    return dst;
     break;
   }
+  case KOOPA_RBO_MUL:
+    emit_mul(dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_DIV:
+    emit_div(dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_MOD:
+    emit_rem(dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_AND:
+    emit_alu(MOp::AND, MOp::ANDI, true, dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_OR:
+    emit_alu(MOp::OR, MOp::ORI, true, dst, binary.lhs, binary.rhs);
+    break;
   case KOOPA_RBO_XOR: {
-    std::optional<reg_t> dst_req = this->ctx->get_avail();
-    if (dst_req) {
-      dst = dst_req.value();
+    if ((lhs && *lhs == -1) || (rhs && *rhs == -1)) {
+      emit_op(MOp::NOT, dst, use(rhs && *rhs == -1 ? binary.lhs : binary.rhs));
     } else {
-      reallocate_register();
+      emit_alu(MOp::XOR, MOp::XORI, true, dst, binary.lhs, binary.rhs);
     }
-    this->output << INDENT << "xor   " << dst.to_string() << ", "
-                 << l_reg.to_string() << ", " << r_reg.to_string() << std::endl;
-    return dst;
     break;
   }
+  case KOOPA_RBO_SHL:
+    emit_shift(MOp::SLL, MOp::SLLI, dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_SHR:
+    emit_shift(MOp::SRL, MOp::SRLI, dst, binary.lhs, binary.rhs);
+    break;
+  case KOOPA_RBO_SAR:
+    emit_shift(MOp::SRA, MOp::SRAI, dst, binary.lhs, binary.rhs);
+    break;
   default:
-    LOG_ERROR("Unimplemented...");
+    LOG_ERROR("Unknown binary operator.");
   }
 }
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "codegen_ctx.hpp"
+#include "emitter.hpp"
 #include "koopa.h"
+#include "mir.hpp"
+#include "regalloc.hpp"
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <optional>
 
 class IKoopaVisitor {
 private:
@@ -11,34 +16,105 @@ private:
   virtual void Visit(const koopa_raw_slice_t &) = 0;
   virtual void Visit(const koopa_raw_function_t &) = 0;
   virtual void Visit(const koopa_raw_basic_block_t &) = 0;
-  virtual reg_t Visit(const koopa_raw_value_t &) = 0;
-  virtual reg_t Visit(const koopa_raw_return_t &) = 0;
+  virtual void Visit(const koopa_raw_value_t &) = 0;
+  virtual void Visit(const koopa_raw_return_t &) = 0;
   virtual reg_t Visit(const koopa_raw_integer_t &) = 0;
-  virtual reg_t Visit(const koopa_raw_binary_t &) = 0;
+  virtual void Visit(const koopa_raw_binary_t &, reg_t dst) = 0;
 
 public:
   virtual ~IKoopaVisitor() = default;
 };
 
+// Code generation runs in stages: each function is lowered into machine IR
+// (`MFunction`), the backend passes rewrite it, and the whole program is
+// printed at the end.
+//
+// Functions are lowered independently of each other: with `jobs > 1` each
+// one becomes a task on a work-stealing pool, filling its own `MFunction`
+// with its own `CodeGenCtx`. They are printed in program order, so the
+// output does not depend on the number of jobs.
 class CodeGenUnit : public IKoopaVisitor {
 private:
-  unsigned int indent_level = 0;
-  std::ostream &output;
+  Emitter output;
+  unsigned jobs = 1;
 
+  // Shared with the per-function workers
+  std::shared_ptr<const IRegisterAllocator> allocator;
   std::unique_ptr<CodeGenCtx> ctx;
+  MProgram mprogram;
+  // Function being lowered
+  MFunction *mfunc = nullptr;
+  std::atomic<std::size_t> peephole_removed{0};
+
+  // Worker lowering single functions
+  explicit CodeGenUnit(std::shared_ptr<const IRegisterAllocator> _allocator)
+      : allocator(std::move(_allocator)) {}
+  void lower_functions_parallel(const koopa_raw_slice_t &funcs);
 
   void Visit(const koopa_raw_program_t &) override;
   void Visit(const koopa_raw_slice_t &) override;
   void Visit(const koopa_raw_function_t &) override;
   void Visit(const koopa_raw_basic_block_t &) override;
-  reg_t Visit(const koopa_raw_value_t &) override;
-  reg_t Visit(const koopa_raw_return_t &) override;
+  void Visit(const koopa_raw_value_t &) override;
+  void Visit(const koopa_raw_return_t &) override;
   reg_t Visit(const koopa_raw_integer_t &) override;
-  reg_t Visit(const koopa_raw_binary_t &) override;
+  void Visit(const koopa_raw_binary_t &, reg_t dst) override;
+
+  // Register holding the operand, loading it into a scratch register first
+  // if it is a constant or has been spilled
+  reg_t use(koopa_raw_value_t);
+  // `reg = value`, as a single `li` for 12-bit values, `lui` + `addi` beyond
+  void emit_li(reg_t reg, std::int32_t value);
+  // `dst = src`, nothing if they are the same register
+  void emit_mv(reg_t dst, reg_t src);
+  void emit(const MInst &inst) { mfunc->insts.push_back(inst); }
+  // `op dst, src`, `op dst, lhs, rhs` and `op dst, src, imm`
+  void emit_op(MOp op, reg_t dst, reg_t src);
+  void emit_op(MOp op, reg_t dst, reg_t lhs, reg_t rhs);
+  void emit_op_imm(MOp op, reg_t dst, reg_t src, std::int32_t imm);
+  // `dst = lhs op rhs` with `op` given as register-register and
+  // register-immediate opcodes (none if there is no immediate form). A
+  // constant operand that fits in 12 bits becomes the immediate, the left one
+  // only if `op` commutes.
+  void emit_alu(MOp rr_op, std::optional<MOp> ri_op, bool commutative,
+                reg_t dst, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+
+  // Lowering of the binary operators that take more than one instruction
+  void emit_compare(koopa_raw_binary_op_t op, reg_t dst, koopa_raw_value_t lhs,
+                    koopa_raw_value_t rhs);
+  void emit_shift(MOp rr_op, MOp ri_op, reg_t dst, koopa_raw_value_t lhs,
+                  koopa_raw_value_t rhs);
+  void emit_mul(reg_t dst, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+  void emit_div(reg_t dst, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+  void emit_rem(reg_t dst, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+  // `t = x + (2^k - 1 if x < 0)`, rounding a shift right by `k` towards zero
+  void emit_pow2_bias(reg_t t, reg_t x, int k);
+  // `dst = x / d` rounded towards zero, with temporaries `t` and `sign`
+  void emit_magic_quotient(reg_t dst, reg_t t, reg_t sign, reg_t x,
+                           std::int32_t d);
+  // Register to compute `value` into; `commit_def` stores it if spilled
+  reg_t def_reg(koopa_raw_value_t);
+  void commit_def(koopa_raw_value_t, reg_t);
+
+  // `op reg, offset(sp)` for loads and stores, for any frame size
+  void emit_sp_access(MOp op, reg_t reg, std::int32_t offset);
+  void emit_sp_adjust(std::int32_t delta);
+  void emit_prologue();
+  void emit_epilogue();
 
 public:
-  CodeGenUnit(std::ostream &_dest) : output(_dest) {
-    ctx = std::make_unique<CodeGenCtx>();
-  }
+  CodeGenUnit(std::ostream &_dest)
+      : output(_dest), allocator(std::make_unique<LinearScanAllocator>()) {}
+  CodeGenUnit(std::ostream &_dest,
+              std::unique_ptr<IRegisterAllocator> _allocator)
+      : output(_dest), allocator(std::move(_allocator)) {}
+
+  // Number of threads generating functions concurrently
+  void set_jobs(unsigned n) { jobs = n ? n : 1; }
+  // Machine IR of the program, after the backend passes
+  MProgram lower(const koopa_raw_program_t &);
+  // Assembly of the program
   void generate(const koopa_raw_program_t &);
+  // Instructions the peephole optimiser removed from all functions
+  std::size_t removed_by_peephole() const { return peephole_removed; }
 };
@@ -1,47 +1,38 @@
 #include "codegen_ctx.hpp"
 #include "logger.hpp"
 
-bool CodeGenCtx::is_avail(const reg_t &reg) {
-  if (reg.series == 't') {
-    return this->t_reg[reg.idx];
-  } else if (reg.series == 'a') {
-    return this->a_reg[reg.idx];
-  } else {
-    LOG_ERROR("Unrecognised register series.");
-  }
+static constexpr const reg_t SCRATCH_REGISTERS[] = {{'t', 5}, {'t', 6}};
+
+CodeGenCtx::CodeGenCtx(Allocation alloc_) : alloc(std::move(alloc_)) {
+  std::int32_t words = alloc.spill_slots + alloc.callee_saved.size() +
+                       (alloc.has_calls ? 1 : 0);
+  // The RISC-V ABI keeps `sp` 16-byte aligned
+  frame_size = (words * 4 + 15) / 16 * 16;
 }
 
-// This will return a free register in the following order:
-// 1. T-registers
-// 2. A-registers
-// but does not guarantee which one is free first.
-std::optional<reg_t> CodeGenCtx::get_avail() {
-  std::optional<reg_t> t_reg = get_avail('t');
-  if (!t_reg) {
-    return get_avail('a');
-  } else {
-    return t_reg;
+const Location &CodeGenCtx::location(koopa_raw_value_t value) const {
+  auto it = alloc.locations.find(value);
+  if (it == alloc.locations.end()) {
+    LOG_ERROR("Value has not been allocated a location.");
   }
+  return it->second;
+}
+
+std::int32_t CodeGenCtx::callee_saved_offset(std::size_t idx) const {
+  return 4 * static_cast<std::int32_t>(alloc.spill_slots + idx);
+}
+
+std::int32_t CodeGenCtx::ra_offset() const {
+  return callee_saved_offset(alloc.callee_saved.size());
+}
+
+bool CodeGenCtx::is_scratch(reg_t reg) const {
+  return reg == SCRATCH_REGISTERS[0] || reg == SCRATCH_REGISTERS[1];
 }
 
-std::optional<reg_t> CodeGenCtx::get_avail(const char &series) {
-  if (series == 't') {
-    for (int i = 0; i < 8; i++) {
-      if (!t_reg[i]) {
-        t_reg[i] = true;
-        return reg_t{'t', i};
-      }
-    }
-    return std::nullopt;
-  } else if (series == 'a') {
-    for (int i = 1; i < 9; i++) {
-      if (!a_reg[i % 8]) {
-        a_reg[i % 8] = true;
-        return reg_t{'a', i};
-      }
-    }
-    return std::nullopt;
-  } else {
-    LOG_ERROR("Unexpected register series.");
+reg_t CodeGenCtx::take_scratch() {
+  if (scratch_used >= 2) {
+    LOG_ERROR("Ran out of scratch registers for a single instruction.");
   }
+  return SCRATCH_REGISTERS[scratch_used++];
 }
@@ -1,35 +1,35 @@
 #pragma once
 
-#include <optional>
-#include <string>
-#include <unordered_map>
+#include <cstdint>
 #include "koopa.h"
-
-struct reg_t {
-  char series;
-  int idx;
-
-  bool operator==(const reg_t &other) const {
-    return (series == other.series && idx == other.idx);
-  }
-
-  bool operator!=(const reg_t &other) const { return !(*this == other); }
-
-  std::string to_string() const {
-    return std::string(1, series) + std::to_string(idx);
-  }
-};
-
+#include "regalloc.hpp"
+#include "register.hpp"
+
+// Per-function state of the code generator: where the register allocator put
+// each value and how the stack frame is laid out.
+//
+// Frame layout, from `sp` upwards:
+//   spill slots | saved callee-saved registers | saved ra
 class CodeGenCtx {
 private:
-  // If set to true, it is being used.
-  bool t_reg[7];
-  bool a_reg[8];
+  // Scratch registers handed out while lowering the current instruction
+  int scratch_used = 0;
 
 public:
-  std::unordered_map<koopa_raw_value_t, reg_t> reg_dict;
+  Allocation alloc;
+  std::int32_t frame_size;
+
+  explicit CodeGenCtx(Allocation);
+
+  const Location &location(koopa_raw_value_t) const;
+
+  // Offset from `sp` at which the idx-th callee-saved register is preserved
+  std::int32_t callee_saved_offset(std::size_t idx) const;
+  std::int32_t ra_offset() const;
 
-  bool is_avail(const reg_t &);
-  std::optional<reg_t> get_avail();
-  std::optional<reg_t> get_avail(const char &);
+  // Scratch registers are never allocated to values, so each instruction may
+  // use them freely to load spilled operands and constants
+  reg_t take_scratch();
+  bool is_scratch(reg_t reg) const;
+  void reset_scratch() { scratch_used = 0; }
 };
@@ -0,0 +1,344 @@
+#include "compile_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#define COMPILE_CACHE_FLOCK 1
+#endif
+
+namespace fs = std::filesystem;
+
+// Bumped whenever the layout of the cache changes, which invalidates all
+// existing entries
+static constexpr std::string_view CACHE_FORMAT = "compile-cache 1";
+
+// Temporary files older than this were left behind by a process that died
+// before renaming them
+static constexpr auto STALE_TMP_AGE = std::chrono::hours(1);
+
+// Eviction removes entries until this fraction of the limit is used, so not
+// every store right at the limit has to evict again
+static constexpr std::uint64_t EVICT_TO_PERCENT = 90;
+
+namespace {
+
+// 128-bit FNV-1a. The prime is 2^88 + 0x13b, so the multiplication comes
+// down to a small product plus a shift.
+class Hash128 {
+private:
+  std::uint64_t hi = 0x6c62272e07bb0142;
+  std::uint64_t lo = 0x62b821756295c58d;
+
+public:
+  void add(std::string_view bytes) {
+    for (unsigned char c : bytes) {
+      lo ^= c;
+      std::uint64_t a = (lo & 0xffffffff) * 0x13b;
+      std::uint64_t b = (lo >> 32) * 0x13b;
+      std::uint64_t new_lo = a + (b << 32);
+      std::uint64_t carry = (b >> 32) + (new_lo < a ? 1 : 0);
+      hi = hi * 0x13b + carry + (lo << 24);
+      lo = new_lo;
+    }
+  }
+
+  // Length first, so that consecutive fields cannot run into each other
+  void add_field(std::string_view bytes) {
+    std::uint64_t size = bytes.size();
+    char raw[8];
+    for (int i = 0; i < 8; i++)
+      raw[i] = static_cast<char>(size >> (8 * i));
+    add(std::string_view(raw, sizeof(raw)));
+    add(bytes);
+  }
+
+  std::string hex() const {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string out(32, '0');
+    for (int i = 0; i < 16; i++) {
+      out[15 - i] = DIGITS[(hi >> (4 * i)) & 0xf];
+      out[31 - i] = DIGITS[(lo >> (4 * i)) & 0xf];
+    }
+    return out;
+  }
+};
+
+// Identifies the compiler binary by its size and modification time, so a
+// rebuilt compiler does not pick up the outputs of the previous one
+const std::string &compiler_identity() {
+  static const std::string identity = [] {
+    std::string id(CACHE_FORMAT);
+#ifdef __linux__
+    std::error_code ec;
+    auto size = fs::file_size("/proc/self/exe", ec);
+    if (!ec)
+      id += " size " + std::to_string(size);
+    auto time = fs::last_write_time("/proc/self/exe", ec);
+    if (!ec)
+      id += " mtime " + std::to_string(time.time_since_epoch().count());
+#endif
+    return id;
+  }();
+  return identity;
+}
+
+bool is_entry_name(const std::string &name) {
+  return name.size() == 32 &&
+         std::all_of(name.begin(), name.end(), [](char c) {
+           return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+         });
+}
+
+// Holds `<dir>/lock` while alive, keeping other processes out of the stats
+// file and eviction. Without `flock` only the threads of one process are
+// serialised.
+class DirLock {
+#ifdef COMPILE_CACHE_FLOCK
+private:
+  int fd;
+
+public:
+  explicit DirLock(const std::string &dir) {
+    fd = ::open((dir + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd >= 0)
+      flock(fd, LOCK_EX);
+  }
+  ~DirLock() {
+    if (fd >= 0)
+      close(fd);
+  }
+#else
+public:
+  explicit DirLock(const std::string &) {}
+#endif
+
+  DirLock(const DirLock &) = delete;
+  DirLock &operator=(const DirLock &) = delete;
+};
+
+struct Entry {
+  fs::path path;
+  fs::file_time_type last_use;
+  std::uint64_t size;
+};
+
+// Entries currently in `dir`. Stale temporary files are removed on the way.
+std::vector<Entry> scan(const std::string &dir) {
+  std::vector<Entry> entries;
+  std::error_code ec;
+  auto now = fs::file_time_type::clock::now();
+  for (auto it = fs::directory_iterator(dir, ec);
+       !ec && it != fs::directory_iterator(); it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    std::error_code entry_ec;
+    auto last_use = it->last_write_time(entry_ec);
+    if (entry_ec)
+      continue;
+    if (name.rfind("tmp-", 0) == 0) {
+      if (now - last_use > STALE_TMP_AGE)
+        fs::remove(it->path(), entry_ec);
+      continue;
+    }
+    if (!is_entry_name(name))
+      continue;
+    auto size = it->file_size(entry_ec);
+    if (!entry_ec)
+      entries.push_back({it->path(), last_use, size});
+  }
+  return entries;
+}
+
+void write_stats(const CompileCache::Stats &stats, std::ostream &out) {
+  out << "hits " << stats.hits << "\n"
+      << "misses " << stats.misses << "\n"
+      << "stores " << stats.stores << "\n"
+      << "evictions " << stats.evictions << "\n"
+      << "entries " << stats.entries << "\n"
+      << "bytes " << stats.bytes << "\n";
+}
+
+} // namespace
+
+bool parse_size(std::string_view text, std::uint64_t &bytes) {
+  std::uint64_t value = 0;
+  std::size_t i = 0;
+  for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; i++)
+    value = value * 10 + static_cast<std::uint64_t>(text[i] - '0');
+  if (i == 0)
+    return false;
+
+  std::string_view suffix = text.substr(i);
+  if (suffix == "K" || suffix == "k")
+    value <<= 10;
+  else if (suffix == "M" || suffix == "m")
+    value <<= 20;
+  else if (suffix == "G" || suffix == "g")
+    value <<= 30;
+  else if (!suffix.empty())
+    return false;
+  bytes = value;
+  return true;
+}
+
+CompileCache::CompileCache(std::string dir_, std::uint64_t max_bytes_)
+    : dir(std::move(dir_)), max_bytes(max_bytes_) {
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  usable = fs::is_directory(dir, ec);
+
+  std::random_device random;
+  tmp_prefix = (std::uint64_t(random()) << 32) ^ random();
+}
+
+CompileCache::~CompileCache() = default;
+
+void CompileCache::set_max_bytes(std::uint64_t max_bytes_) {
+  std::lock_guard<std::mutex> lock(mutex);
+  max_bytes = max_bytes_;
+}
+
+std::string CompileCache::key(std::string_view source,
+                              std::string_view settings) {
+  Hash128 hash;
+  hash.add_field(compiler_identity());
+  hash.add_field(settings);
+  hash.add_field(source);
+  return hash.hex();
+}
+
+std::string CompileCache::entry_path(const std::string &key) const {
+  return dir + "/" + key;
+}
+
+std::string CompileCache::tmp_path() {
+  return dir + "/tmp-" + std::to_string(tmp_prefix) + "-" +
+         std::to_string(tmp_count++);
+}
+
+bool CompileCache::fetch(const std::string &key, const std::string &output) {
+  if (!usable) {
+    misses++;
+    return false;
+  }
+
+  // An entry evicted meanwhile by another process is simply a miss
+  std::error_code ec;
+  std::string path = entry_path(key);
+  fs::copy_file(path, output, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    misses++;
+    return false;
+  }
+
+  // Mark it as recently used for eviction
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  hits++;
+  return true;
+}
+
+void CompileCache::store(const std::string &key, const std::string &output) {
+  if (!usable)
+    return;
+
+  std::error_code ec;
+  std::string tmp = tmp_path();
+  fs::copy_file(output, tmp, ec);
+  if (!ec)
+    fs::rename(tmp, entry_path(key), ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return;
+  }
+  stores++;
+  evict();
+}
+
+void CompileCache::evict() {
+  std::lock_guard<std::mutex> lock(mutex);
+  DirLock dir_lock(dir);
+
+  auto entries = scan(dir);
+  std::uint64_t total = 0;
+  for (auto const &e : entries)
+    total += e.size;
+  if (total <= max_bytes)
+    return;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.last_use < b.last_use;
+            });
+  std::uint64_t target = max_bytes / 100 * EVICT_TO_PERCENT;
+  for (auto const &e : entries) {
+    if (total <= target)
+      break;
+    std::error_code ec;
+    if (fs::remove(e.path, ec)) {
+      total -= e.size;
+      evictions++;
+    }
+  }
+}
+
+CompileCache::Stats CompileCache::flush_stats() {
+  Stats totals;
+  if (!usable)
+    return totals;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  DirLock dir_lock(dir);
+
+  std::ifstream in(dir + "/stats");
+  std::string name;
+  std::uint64_t value;
+  while (in >> name >> value) {
+    if (name == "hits")
+      totals.hits = value;
+    else if (name == "misses")
+      totals.misses = value;
+    else if (name == "stores")
+      totals.stores = value;
+    else if (name == "evictions")
+      totals.evictions = value;
+  }
+
+  Stats now;
+  now.hits = hits;
+  now.misses = misses;
+  now.stores = stores;
+  now.evictions = evictions;
+  totals.hits += now.hits - flushed.hits;
+  totals.misses += now.misses - flushed.misses;
+  totals.stores += now.stores - flushed.stores;
+  totals.evictions += now.evictions - flushed.evictions;
+  flushed = now;
+
+  for (auto const &e : scan(dir)) {
+    totals.entries++;
+    totals.bytes += e.size;
+  }
+
+  // Replaced as a whole, so scrapers never read a partial file
+  std::string tmp = tmp_path();
+  {
+    std::ofstream out(tmp);
+    write_stats(totals, out);
+  }
+  std::error_code ec;
+  fs::rename(tmp, dir + "/stats", ec);
+  if (ec)
+    fs::remove(tmp, ec);
+  return totals;
+}
+
+void CompileCache::print_stats(const Stats &stats, std::ostream &out) {
+  write_stats(stats, out);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// On-disk cache of compiler outputs, enabled with `-cache-dir`. An entry is a
+// whole output file named by the key of its unit: a 128-bit hash of the
+// source text, the settings that change the output and the identity of the
+// compiler binary. A hit copies the entry to the output without parsing.
+//
+// Entries are written to a temporary file and renamed into place, so other
+// processes sharing the directory never see a partial one. Hits refresh the
+// modification time of an entry; when the directory grows beyond its limit
+// the entries used least recently are removed. Hit/miss counters of all
+// processes are summed up in `<dir>/stats`, one `name value` pair per line.
+class CompileCache {
+public:
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t stores = 0;
+    std::uint64_t evictions = 0;
+    // Size of the directory, only known for the totals
+    std::uint64_t entries = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  // Creates `dir` if needed. Entries are evicted once they take up more than
+  // `max_bytes` together.
+  CompileCache(std::string dir, std::uint64_t max_bytes);
+  ~CompileCache();
+
+  CompileCache(const CompileCache &) = delete;
+  CompileCache &operator=(const CompileCache &) = delete;
+
+  // False if the directory could not be created; all lookups then miss and
+  // nothing is stored
+  bool is_usable() const { return usable; }
+
+  void set_max_bytes(std::uint64_t max_bytes_);
+
+  // Key of a unit with text `source` compiled with `settings`, which must
+  // spell out every option that affects the output
+  static std::string key(std::string_view source, std::string_view settings);
+
+  // Copies the entry for `key` to `output`. Returns false on a miss.
+  bool fetch(const std::string &key, const std::string &output);
+
+  // Stores a copy of the finished `output` under `key`
+  void store(const std::string &key, const std::string &output);
+
+  // Adds the counters of this process to the totals in the directory and
+  // returns the new totals. Further calls only add what happened since.
+  Stats flush_stats();
+
+  static void print_stats(const Stats &stats, std::ostream &out);
+
+private:
+  std::string dir;
+  std::uint64_t max_bytes;
+  bool usable = false;
+
+  std::atomic<std::uint64_t> hits{0};
+  std::atomic<std::uint64_t> misses{0};
+  std::atomic<std::uint64_t> stores{0};
+  std::atomic<std::uint64_t> evictions{0};
+  // Counters already added to the totals by `flush_stats`
+  Stats flushed;
+
+  // Names of temporary files of this process
+  std::uint64_t tmp_prefix;
+  std::atomic<std::uint64_t> tmp_count{0};
+
+  // Serialises eviction and the stats file among the threads of this
+  // process; other processes are kept out by a lock file
+  std::mutex mutex;
+
+  std::string entry_path(const std::string &key) const;
+  std::string tmp_path();
+  void evict();
+};
+
+// Parses a size such as `4096`, `512K`, `64M` or `2G`. Returns false if `text`
+// is not one.
+bool parse_size(std::string_view text, std::uint64_t &bytes);
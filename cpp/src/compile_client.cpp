@@ -0,0 +1,52 @@
+#include "compile_client.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "compile_protocol.hpp"
+#include <climits>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int forward_to_server(const char *socket_path, int argc, const char *argv[]) {
+  using namespace compile_protocol;
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(socket_path) >= sizeof(addr.sun_path))
+    return -1;
+  std::strcpy(addr.sun_path, socket_path);
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd)))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  bool ok = write_u32(fd, static_cast<std::uint32_t>(argc) + 1) &&
+            write_string(fd, cwd);
+  for (int i = 0; ok && i < argc; i++)
+    ok = write_string(fd, argv[i]);
+
+  std::uint32_t status = 0;
+  std::string out, err;
+  ok = ok && read_u32(fd, status) && read_string(fd, out) &&
+       read_string(fd, err);
+  close(fd);
+  if (!ok)
+    return -1;
+
+  write_all(STDOUT_FILENO, out.data(), out.size());
+  write_all(STDERR_FILENO, err.data(), err.size());
+  return static_cast<int>(status);
+}
+#else
+int forward_to_server(const char *, int, const char *[]) { return -1; }
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+// Has the compile server on `socket_path` run the command line `argv`, as if
+// in the current directory, and copies its output to stdout and stderr.
+// Returns the exit status of the run, or -1 if no server answered. Does not
+// depend on the rest of the compiler, so thin clients can link just this.
+int forward_to_server(const char *socket_path, int argc, const char *argv[]);
@@ -0,0 +1,69 @@
+#pragma once
+
+// Messages between the compile server and its clients on a Unix domain
+// socket. Both ends run on the same machine, so integers are sent in host
+// byte order.
+//
+//   request:  u32 count, then `count` strings: the client's working
+//             directory followed by its command line, program name first
+//   response: u32 exit status, string stdout, string stderr
+//
+// A string is a u32 length followed by that many bytes.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unistd.h>
+
+namespace compile_protocol {
+
+// Longer strings are taken as a broken peer rather than allocated
+static constexpr std::uint32_t MAX_STRING = 1u << 30;
+
+inline bool write_all(int fd, const void *data, std::size_t size) {
+  auto *p = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+inline bool read_all(int fd, void *data, std::size_t size) {
+  auto *p = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t n = ::read(fd, p, size);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+inline bool write_u32(int fd, std::uint32_t value) {
+  return write_all(fd, &value, sizeof(value));
+}
+
+inline bool read_u32(int fd, std::uint32_t &value) {
+  return read_all(fd, &value, sizeof(value));
+}
+
+inline bool write_string(int fd, const std::string &s) {
+  return s.size() <= MAX_STRING &&
+         write_u32(fd, static_cast<std::uint32_t>(s.size())) &&
+         write_all(fd, s.data(), s.size());
+}
+
+inline bool read_string(int fd, std::string &s) {
+  std::uint32_t size;
+  if (!read_u32(fd, size) || size > MAX_STRING)
+    return false;
+  s.resize(size);
+  return read_all(fd, s.data(), size);
+}
+
+} // namespace compile_protocol
@@ -0,0 +1,110 @@
+#include "compile_server.hpp"
+#include "driver.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "compile_protocol.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Reads one request from `fd`, runs it and answers it
+void serve(int fd, DriverContext &context) {
+  using namespace compile_protocol;
+
+  std::uint32_t count;
+  if (!read_u32(fd, count) || count < 2) {
+    close(fd);
+    return;
+  }
+  std::string cwd;
+  std::vector<std::string> args(count - 1);
+  bool ok = read_string(fd, cwd);
+  for (auto &arg : args) {
+    ok = ok && read_string(fd, arg);
+  }
+  if (!ok) {
+    close(fd);
+    return;
+  }
+
+  std::ostringstream out, err;
+  int status;
+  try {
+    status = run_driver(args, cwd, out, err, context);
+  } catch (const std::exception &e) {
+    err << "error: " << e.what() << '\n';
+    status = 1;
+  }
+
+  // The client may be gone already, there is nobody left to tell then
+  write_u32(fd, static_cast<std::uint32_t>(status));
+  write_string(fd, out.str());
+  write_string(fd, err.str());
+  close(fd);
+}
+
+} // namespace
+
+int run_server(const std::string &socket_path, std::ostream &err) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    err << "error: socket path too long: " << socket_path << '\n';
+    return 1;
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+  auto *sa = reinterpret_cast<sockaddr *>(&addr);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err << "error: unable to create socket: " << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  // A socket left behind by a server that died is replaced, a live one not
+  if (connect(fd, sa, sizeof(addr)) == 0) {
+    err << "error: a server is already listening on " << socket_path << '\n';
+    close(fd);
+    return 1;
+  }
+  unlink(socket_path.c_str());
+  if (bind(fd, sa, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+    err << "error: unable to listen on " << socket_path << ": "
+        << std::strerror(errno) << '\n';
+    close(fd);
+    return 1;
+  }
+
+  // Writing to a client that hung up must not end the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  DriverContext context;
+  while (true) {
+    int client = accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      err << "error: accept failed: " << std::strerror(errno) << '\n';
+      close(fd);
+      return 1;
+    }
+    std::thread(serve, client, std::ref(context)).detach();
+  }
+}
+#else
+int run_server(const std::string &, std::ostream &err) {
+  err << "error: the compile server needs Unix domain sockets\n";
+  return 1;
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+// Long-lived compiler started with `compiler -server socket`. Clients (see
+// `forward_to_server`) send their command line over the Unix domain socket
+// and get back what the compiler would have printed and its exit status.
+// Requests are served concurrently, each on a thread of its own, and share
+// one `DriverContext`, so a request pays neither for process start-up nor
+// for opening the cache. Runs until killed; returns only if the socket
+// cannot be set up, after reporting why to `err`.
+int run_server(const std::string &socket_path, std::ostream &err);
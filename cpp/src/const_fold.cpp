@@ -0,0 +1,304 @@
+#include "const_fold.hpp"
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace koopa_ast {
+
+static const Integer *as_const(const Value *value) {
+  if (value->kind() != ValueKind::Integer)
+    return nullptr;
+  return static_cast<const Integer *>(value);
+}
+
+static bool is_const(const Value *value, std::int32_t val) {
+  auto *integer = as_const(value);
+  return integer && integer->get_val() == val;
+}
+
+static const Binary *as_binary(const Value *value) {
+  if (value->kind() != ValueKind::Binary)
+    return nullptr;
+  return static_cast<const Binary *>(value);
+}
+
+// `!(a op b)` expressed as `a op' b`, for comparisons only
+static std::optional<BinaryOp> invert_comparison(BinaryOp op) {
+  switch (op) {
+  case BinaryOp::NotEq:
+    return BinaryOp::Eq;
+  case BinaryOp::Eq:
+    return BinaryOp::NotEq;
+  case BinaryOp::Gt:
+    return BinaryOp::Le;
+  case BinaryOp::Lt:
+    return BinaryOp::Ge;
+  case BinaryOp::Ge:
+    return BinaryOp::Lt;
+  case BinaryOp::Le:
+    return BinaryOp::Gt;
+  default:
+    return std::nullopt;
+  }
+}
+
+std::optional<std::int32_t> eval_binary(BinaryOp op, std::int32_t lhs,
+                                        std::int32_t rhs) {
+  // Do the wrapping arithmetic in unsigned, where overflow is well defined
+  auto ul = static_cast<std::uint32_t>(lhs);
+  auto ur = static_cast<std::uint32_t>(rhs);
+  std::uint32_t shamt = ur & 31;
+
+  switch (op) {
+  case BinaryOp::NotEq:
+    return lhs != rhs;
+  case BinaryOp::Eq:
+    return lhs == rhs;
+  case BinaryOp::Gt:
+    return lhs > rhs;
+  case BinaryOp::Lt:
+    return lhs < rhs;
+  case BinaryOp::Ge:
+    return lhs >= rhs;
+  case BinaryOp::Le:
+    return lhs <= rhs;
+  case BinaryOp::Add:
+    return static_cast<std::int32_t>(ul + ur);
+  case BinaryOp::Sub:
+    return static_cast<std::int32_t>(ul - ur);
+  case BinaryOp::Mul:
+    return static_cast<std::int32_t>(ul * ur);
+  case BinaryOp::Div:
+    if (rhs == 0)
+      return std::nullopt;
+    if (lhs == INT32_MIN && rhs == -1)
+      return INT32_MIN;
+    return lhs / rhs;
+  case BinaryOp::Mod:
+    if (rhs == 0)
+      return std::nullopt;
+    if (lhs == INT32_MIN && rhs == -1)
+      return 0;
+    return lhs % rhs;
+  case BinaryOp::And:
+    return lhs & rhs;
+  case BinaryOp::Or:
+    return lhs | rhs;
+  case BinaryOp::Xor:
+    return lhs ^ rhs;
+  case BinaryOp::Shl:
+    return static_cast<std::int32_t>(ul << shamt);
+  case BinaryOp::Shr:
+    return static_cast<std::int32_t>(ul >> shamt);
+  case BinaryOp::Sar:
+    return lhs < 0 ? ~(~lhs >> shamt) : lhs >> shamt;
+  }
+  return std::nullopt;
+}
+
+// Returns the value `binary` can be replaced with: a constant, one of its
+// operands, a new (not yet placed) instruction, or `binary` itself.
+static Value *simplify(Binary &binary, BasicBlock &block) {
+  BinaryOp op = binary.get_op();
+  Value *lhs = binary.get_lhs();
+  Value *rhs = binary.get_rhs();
+  auto lc = as_const(lhs);
+  auto rc = as_const(rhs);
+
+  if (lc && rc) {
+    auto folded = eval_binary(op, lc->get_val(), rc->get_val());
+    if (!folded)
+      return &binary;
+    return block.Make<Integer>(false, *folded);
+  }
+
+  // Only look at `x op c` below, `c op x` is the same when op commutes
+  if (lc && is_commutative(op)) {
+    std::swap(lhs, rhs);
+    std::swap(lc, rc);
+  }
+
+  auto make_const = [&](std::int32_t val) -> Value * {
+    return block.Make<Integer>(false, val);
+  };
+
+  // Identities on a single non constant operand
+  if (lhs == rhs) {
+    switch (op) {
+    case BinaryOp::Sub:
+    case BinaryOp::Xor:
+    case BinaryOp::NotEq:
+    case BinaryOp::Gt:
+    case BinaryOp::Lt:
+      return make_const(0);
+    case BinaryOp::Eq:
+    case BinaryOp::Ge:
+    case BinaryOp::Le:
+      return make_const(1);
+    case BinaryOp::And:
+    case BinaryOp::Or:
+      return lhs;
+    default:
+      break;
+    }
+  }
+
+  if (rc) {
+    const Binary *inner = as_binary(lhs);
+    std::int32_t c = rc->get_val();
+
+    switch (op) {
+    case BinaryOp::Add:
+    case BinaryOp::Sub:
+    case BinaryOp::Or:
+    case BinaryOp::Shl:
+    case BinaryOp::Shr:
+    case BinaryOp::Sar:
+      if (c == 0)
+        return lhs;
+      if (op == BinaryOp::Or && c == -1)
+        return rhs;
+      break;
+    case BinaryOp::Xor:
+      if (c == 0)
+        return lhs;
+      // ~~x
+      if (c == -1 && inner && inner->get_op() == BinaryOp::Xor) {
+        if (is_const(inner->get_rhs(), -1))
+          return inner->get_lhs();
+        if (is_const(inner->get_lhs(), -1))
+          return inner->get_rhs();
+      }
+      break;
+    case BinaryOp::Mul:
+      if (c == 1)
+        return lhs;
+      if (c == 0)
+        return rhs;
+      break;
+    case BinaryOp::Div:
+      if (c == 1)
+        return lhs;
+      break;
+    case BinaryOp::Mod:
+      if (c == 1 || c == -1)
+        return make_const(0);
+      break;
+    case BinaryOp::And:
+      if (c == -1)
+        return lhs;
+      if (c == 0)
+        return rhs;
+      break;
+    case BinaryOp::Eq:
+    case BinaryOp::NotEq: {
+      // Comparisons produce 0 or 1, so testing one against 0 or 1 is either
+      // the comparison itself or its inverse, e.g. `!!x` is `x != 0`.
+      auto inverse = inner ? invert_comparison(inner->get_op()) : std::nullopt;
+      if (!inverse || (c != 0 && c != 1))
+        break;
+      bool keeps_truth = (op == BinaryOp::NotEq) == (c == 0);
+      if (keeps_truth)
+        return lhs;
+      return block.Make<Binary>(false, *inverse, inner->get_lhs(),
+                                inner->get_rhs());
+    }
+    default:
+      break;
+    }
+  }
+
+  // - - x
+  if (op == BinaryOp::Sub && lc && lc->get_val() == 0) {
+    const Binary *inner = as_binary(rhs);
+    if (inner && inner->get_op() == BinaryOp::Sub &&
+        is_const(inner->get_lhs(), 0))
+      return inner->get_rhs();
+  }
+
+  return &binary;
+}
+
+std::size_t fold_constants(Function &func) {
+  std::size_t changed = 0;
+
+  // Folded instruction -> the value its users should see instead. Users may
+  // be in later blocks, so this covers the whole function.
+  std::unordered_map<const Value *, Value *> replaced;
+  auto resolve = [&](Value *value) {
+    auto it = replaced.find(value);
+    return it == replaced.end() ? value : it->second;
+  };
+
+  for (auto &bb : func.basicblocks) {
+    if (!bb)
+      continue;
+
+    std::vector<Value *> insts;
+    insts.reserve(bb->insts.size());
+
+    for (auto *inst : bb->insts) {
+      if (!inst)
+        continue;
+
+      switch (inst->kind()) {
+      case ValueKind::Binary: {
+        auto *binary = static_cast<Binary *>(inst);
+        binary->set_operands(resolve(binary->get_lhs()),
+                             resolve(binary->get_rhs()));
+
+        // A rewrite may enable another one (`x == 0 == 0` -> `x != 0` -> x),
+        // keep going until nothing changes
+        std::size_t pool_size = bb->pool.size();
+        Value *result = binary;
+        for (Value *next = simplify(*binary, *bb); next != result;) {
+          result = next;
+          if (result->kind() != ValueKind::Binary)
+            break;
+          next = simplify(*static_cast<Binary *>(result), *bb);
+        }
+
+        if (result == binary) {
+          insts.push_back(binary);
+          break;
+        }
+
+        changed++;
+        replaced[binary] = result;
+        // Rewritten instructions are new and take the original's place, as
+        // opposed to existing values the original simplified to
+        for (std::size_t i = pool_size; i < bb->pool.size(); i++) {
+          if (bb->pool[i].get() == result && result->kind() == ValueKind::Binary)
+            insts.push_back(result);
+        }
+        break;
+      }
+      case ValueKind::Return: {
+        auto *ret = static_cast<Return *>(inst);
+        if (ret->get_return_val())
+          ret->set_return_val(resolve(ret->get_return_val()));
+        insts.push_back(ret);
+        break;
+      }
+      default:
+        insts.push_back(inst);
+        break;
+      }
+    }
+
+    bb->insts = std::move(insts);
+  }
+
+  return changed;
+}
+
+std::size_t fold_constants(Program &program) {
+  std::size_t changed = 0;
+  for (auto &func : program.functions) {
+    if (func)
+      changed += fold_constants(*func);
+  }
+  return changed;
+}
+
+} // namespace koopa_ast
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "koopa_ast.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace koopa_ast {
+
+// Evaluates `lhs op rhs` with SysY's 32-bit two's complement wrapping
+// semantics. Returns nothing when the result is not a compile time constant
+// (division or modulo by zero are left for the target to decide).
+std::optional<std::int32_t> eval_binary(BinaryOp op, std::int32_t lhs,
+                                        std::int32_t rhs);
+
+// Folds `Binary` instructions with constant operands and applies algebraic
+// identities (`x + 0`, `x ^ 0`, `x * 1`, `- - x`, `!!x` -> `x != 0`, ...).
+// Instructions that are folded away are dropped from `insts` and their users
+// are rewritten; they stay in the block's pool. Returns how many instructions
+// were removed or replaced.
+std::size_t fold_constants(Function &func);
+std::size_t fold_constants(Program &program);
+
+} // namespace koopa_ast
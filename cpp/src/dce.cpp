@@ -0,0 +1,85 @@
+#include "dce.hpp"
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+
+namespace koopa_ast {
+
+// Instructions that must stay even when nothing uses their result
+static bool has_side_effects(const Value *inst) {
+  return inst->kind() != ValueKind::Binary;
+}
+
+// Calls `f` on each operand of `value`
+template <class F> static void for_each_operand(const Value *value, F &&f) {
+  switch (value->kind()) {
+  case ValueKind::Binary: {
+    auto *binary = static_cast<const Binary *>(value);
+    f(binary->get_lhs());
+    f(binary->get_rhs());
+    break;
+  }
+  case ValueKind::Return: {
+    auto *ret = static_cast<const Return *>(value);
+    if (ret->get_return_val())
+      f(ret->get_return_val());
+    break;
+  }
+  case ValueKind::Integer:
+    break;
+  }
+}
+
+std::size_t eliminate_dead_code(Function &func) {
+  // Mark: everything reachable through operands from the side effects. An
+  // operand may be defined in another block, so this covers the function.
+  std::unordered_set<const Value *> live;
+  std::vector<const Value *> worklist;
+  auto mark = [&](const Value *value) {
+    if (value && live.insert(value).second)
+      worklist.push_back(value);
+  };
+
+  for (auto const &bb : func.basicblocks) {
+    if (!bb)
+      continue;
+    for (auto const *inst : bb->insts) {
+      if (inst && has_side_effects(inst))
+        mark(inst);
+    }
+  }
+  while (!worklist.empty()) {
+    const Value *value = worklist.back();
+    worklist.pop_back();
+    for_each_operand(value, mark);
+  }
+
+  // Sweep: unmarked instructions leave `insts`, unmarked values the pool
+  std::size_t removed = 0;
+  for (auto &bb : func.basicblocks) {
+    if (!bb)
+      continue;
+
+    auto dead = [&](const Value *value) { return !live.count(value); };
+    auto insts_end = std::remove_if(bb->insts.begin(), bb->insts.end(), dead);
+    removed += static_cast<std::size_t>(bb->insts.end() - insts_end);
+    bb->insts.erase(insts_end, bb->insts.end());
+
+    auto pool_end = std::remove_if(
+        bb->pool.begin(), bb->pool.end(),
+        [&](const std::unique_ptr<Value> &value) { return dead(value.get()); });
+    bb->pool.erase(pool_end, bb->pool.end());
+  }
+  return removed;
+}
+
+std::size_t eliminate_dead_code(Program &program) {
+  std::size_t removed = 0;
+  for (auto &func : program.functions) {
+    if (func)
+      removed += eliminate_dead_code(*func);
+  }
+  return removed;
+}
+
+} // namespace koopa_ast
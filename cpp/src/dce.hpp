@@ -0,0 +1,16 @@
+#pragma once
+
+#include "koopa_ast.hpp"
+#include <cstddef>
+
+namespace koopa_ast {
+
+// Mark-sweep dead code elimination. Instructions with side effects (`ret`)
+// are live, and so is every instruction they use, transitively; all other
+// instructions are dropped from `insts`. Values no live instruction refers
+// to, such as constants left behind by folding, are freed from the blocks'
+// pools. Returns how many instructions were removed.
+std::size_t eliminate_dead_code(Function &func);
+std::size_t eliminate_dead_code(Program &program);
+
+} // namespace koopa_ast
@@ -0,0 +1,486 @@
+#include "arena.hpp"
+#include "c_ast.hpp"
+#include "codegen.hpp"
+#include "compile_cache.hpp"
+#include "const_fold.hpp"
+#include "dce.hpp"
+#include "driver.hpp"
+#include "elf_writer.hpp"
+#include "emitter.hpp"
+#include "ir_builder.hpp"
+#include "koopa.h"
+#include "koopa_ast.hpp"
+#include "parser.hpp"
+#include "raw_builder.hpp"
+#include "riscv_encoder.hpp"
+#include "source_file.hpp"
+#include "time_report.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class COMPILE_MODE { KOOPA_IR, RISC_V, OBJECT };
+enum class AST_DUMP { NONE, TEXT, JSON };
+
+bool parse_compile_mode(const std::string &arg, COMPILE_MODE &mode,
+                        std::ostream &err) {
+  std::string name = arg.substr(1);
+  if (name == "koopa") {
+    mode = COMPILE_MODE::KOOPA_IR;
+    return true;
+  }
+  if (name == "riscv") {
+    mode = COMPILE_MODE::RISC_V;
+    return true;
+  }
+  if (name == "obj") {
+    mode = COMPILE_MODE::OBJECT;
+    return true;
+  }
+
+  err << "error: unknown compile mode '-" << name
+      << "'. Expected '-koopa', '-riscv' or '-obj'.\n";
+  return false;
+}
+
+// Returns the exit status of a run with a bad command line
+int usage(const std::string &prog, std::ostream &err) {
+  err << "usage: " << prog
+      << " -koopa|-riscv|-obj input_file -o output_file [options]\n"
+      << "       " << prog
+      << " -koopa|-riscv|-obj input_file... -o output_dir [options]\n"
+      << "       " << prog
+      << " -koopa|-riscv|-obj -manifest file [options]\n"
+      << "       " << prog << " -server socket\n"
+      << "options: [-O2] [-jN] [-ftime-report[=json]]"
+      << " [-dump-ast[=json] [-dump-ast-o file]]\n"
+      << "         [-cache-dir dir [-cache-size bytes[K|M|G]]"
+      << " [-cache-stats]]\n";
+  return 1;
+}
+
+// Settings shared by every unit of one compiler invocation
+struct Options {
+  COMPILE_MODE mode;
+  // `-O2` spends more compile time on graph-colouring register allocation
+  bool optimize = false;
+  AST_DUMP ast_dump = AST_DUMP::NONE;
+  std::ostream *ast_sink = nullptr;
+  // Where errors are reported
+  std::ostream *err = nullptr;
+  // Units are compiled concurrently, anything shared is written under this
+  std::mutex *output_mutex = nullptr;
+  // Threads generating the functions of one unit
+  unsigned codegen_jobs = 1;
+  // Outputs of earlier compilations, if `-cache-dir` is given
+  CompileCache *cache = nullptr;
+  // Everything besides the source that the output depends on, part of the
+  // cache key
+  std::string cache_settings;
+};
+
+// Writes `msg` under the output mutex so messages of parallel units stay whole
+void report_error(const Options &opts, const std::string &msg) {
+  std::lock_guard<std::mutex> lock(*opts.output_mutex);
+  *opts.err << msg << '\n';
+}
+
+// Compiles one translation unit. Returns false, after reporting why, if it
+// could not be compiled; the process state is left ready for the next unit.
+bool compile_unit(const Options &opts, const std::string &input,
+                  const std::string &output, TimeReport &report) {
+  // Map the input file, the parser scans it in place with a scanner of its
+  // own. It stays mapped until the unit is done, as the AST refers to it.
+  auto source = SourceFile::open(input);
+  if (!source) {
+    report_error(opts, "Unable to read input file: " + input);
+    return false;
+  }
+
+  // A unit compiled before is copied from the cache without being parsed.
+  // The key is taken before the scanner writes into the source. An AST dump
+  // needs the parse, so it only stores.
+  std::string cache_key;
+  if (opts.cache) {
+    auto phase = report.phase("compile cache");
+    cache_key = CompileCache::key(
+        std::string_view(source->data(), source->size()), opts.cache_settings);
+    if (opts.ast_dump == AST_DUMP::NONE &&
+        opts.cache->fetch(cache_key, output)) {
+      return true;
+    }
+  }
+
+  // The whole C AST lives in `c_ast_arena` and is released in one go with it
+  Arena c_ast_arena;
+  c_ast::BaseAST *c_ast = nullptr;
+  std::string parse_error;
+  {
+    auto phase = report.phase("parse");
+    c_ast = parse_unit(*source, c_ast_arena, parse_error);
+  }
+  if (!c_ast) {
+    report_error(opts, "error: " + parse_error);
+    report_error(opts, input + ": failed to parse");
+    return false;
+  }
+
+  // Only created once there is something to write, so a failed unit leaves
+  // no empty output behind
+  std::ofstream output_stream(output, opts.mode == COMPILE_MODE::OBJECT
+                                          ? std::ios::out | std::ios::binary
+                                          : std::ios::out);
+  if (output_stream.is_open() == false) {
+    report_error(opts, "Unable to write to output file: " + output);
+    return false;
+  }
+
+  // Debug dump of the C AST, only when asked for. It is rendered on the side
+  // and written whole, so dumps of parallel units do not interleave.
+  if (opts.ast_dump != AST_DUMP::NONE) {
+    auto phase = report.phase("dump C AST");
+    std::ostringstream dump;
+    {
+      Emitter emitter(dump);
+      if (opts.ast_dump == AST_DUMP::JSON) {
+        c_ast->DumpJson(emitter);
+      } else {
+        c_ast->Dump(emitter);
+      }
+      emitter << '\n';
+    }
+    std::lock_guard<std::mutex> lock(*opts.output_mutex);
+    *opts.ast_sink << dump.str();
+  }
+
+  // Translate to Koopa IR
+  std::unique_ptr<koopa_ast::Program> ret_in_koopa;
+  {
+    auto phase = report.phase("build Koopa IR");
+    ret_in_koopa = convert_to_custom_koopa_from_c_reps(*c_ast);
+  }
+  {
+    auto phase = report.phase("fold constants");
+    report.count("folded instructions",
+                 koopa_ast::fold_constants(*ret_in_koopa));
+  }
+  {
+    auto phase = report.phase("eliminate dead code");
+    report.count("dead instructions removed",
+                 koopa_ast::eliminate_dead_code(*ret_in_koopa));
+  }
+
+  if (opts.mode == COMPILE_MODE::KOOPA_IR) {
+    // Output to the file
+    auto phase = report.phase("dump Koopa IR");
+    Emitter emitter(output_stream);
+    ret_in_koopa->Dump(emitter);
+  } else {
+    // Lower directly to koopa raw program, the builder owns all raw structures
+    RawProgramBuilder raw_builder;
+    koopa_raw_program_t koopa_raw_program;
+    {
+      auto phase = report.phase("lower to raw");
+      koopa_raw_program = raw_builder.build(*ret_in_koopa);
+    }
+
+    // Generate RISC_V
+    std::unique_ptr<IRegisterAllocator> allocator;
+    if (opts.optimize) {
+      allocator = std::make_unique<GraphColoringAllocator>();
+    } else {
+      allocator = std::make_unique<LinearScanAllocator>();
+    }
+    CodeGenUnit gen(output_stream, std::move(allocator));
+    gen.set_jobs(opts.codegen_jobs);
+    if (opts.mode == COMPILE_MODE::RISC_V) {
+      auto phase = report.phase("generate RISC-V");
+      gen.generate(koopa_raw_program);
+    } else {
+      // Machine code straight from the MIR, no assembler involved
+      MProgram mir;
+      {
+        auto phase = report.phase("generate RISC-V");
+        mir = gen.lower(koopa_raw_program);
+      }
+      auto phase = report.phase("write object");
+      write_elf_object(encode_program(mir), output_stream);
+    }
+    report.count("peephole instructions removed", gen.removed_by_peephole());
+  }
+
+  // Closed before it is cached, so the entry holds the complete output
+  output_stream.close();
+  if (!output_stream) {
+    report_error(opts, "Unable to write to output file: " + output);
+    return false;
+  }
+  if (opts.cache) {
+    auto phase = report.phase("compile cache");
+    opts.cache->store(cache_key, output);
+  }
+
+  return true;
+}
+
+// `path` as seen from directory `cwd`
+std::string resolve_path(const std::string &cwd, const std::string &path) {
+  if (cwd.empty() || path.empty() || path[0] == '/') {
+    return path;
+  }
+  return cwd + "/" + path;
+}
+
+// `input output` pairs, one per line; blank lines and `#` comments skipped.
+// Returns false, after reporting why, if the manifest cannot be used.
+bool read_manifest(const std::string &path,
+                   std::vector<std::pair<std::string, std::string>> &units,
+                   std::ostream &err) {
+  std::ifstream manifest(path);
+  if (!manifest.is_open()) {
+    err << "Unable to read manifest: " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (int line_no = 1; std::getline(manifest, line); line_no++) {
+    std::istringstream fields(line);
+    std::string input, output;
+    if (!(fields >> input) || input[0] == '#') {
+      continue;
+    }
+    if (!(fields >> output)) {
+      err << path << ":" << line_no << ": missing output file" << std::endl;
+      return false;
+    }
+    units.emplace_back(std::move(input), std::move(output));
+  }
+  return true;
+}
+
+// `dir/name.ext` for input `some/path/name.c`
+std::string output_in_dir(const std::string &dir, const std::string &input,
+                          COMPILE_MODE mode) {
+  std::string name = input.substr(input.find_last_of('/') + 1);
+  name = name.substr(0, name.find_last_of('.'));
+  const char *ext = mode == COMPILE_MODE::KOOPA_IR ? ".koopa"
+                    : mode == COMPILE_MODE::OBJECT  ? ".o"
+                                                    : ".S";
+  return dir + "/" + name + ext;
+}
+
+// Two units writing the same file would lose one output, and with `-j` have
+// two workers write it at once. Reports every clash, returns false if any.
+bool check_distinct_outputs(
+    const std::vector<std::pair<std::string, std::string>> &units,
+    std::ostream &err) {
+  std::unordered_map<std::string, const std::string *> writer;
+  bool ok = true;
+  for (auto const &[input, output] : units) {
+    std::string path =
+        std::filesystem::path(output).lexically_normal().string();
+    auto [it, inserted] = writer.emplace(path, &input);
+    if (!inserted) {
+      err << "error: " << *it->second << " and " << input
+          << " would both be written to " << output << '\n';
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+CompileCache &DriverContext::cache(const std::string &dir,
+                                   std::uint64_t max_bytes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &cache = caches[dir];
+  if (!cache) {
+    cache = std::make_unique<CompileCache>(dir, max_bytes);
+  } else {
+    cache->set_max_bytes(max_bytes);
+  }
+  return *cache;
+}
+
+int run_driver(const std::vector<std::string> &args, const std::string &cwd,
+               std::ostream &out, std::ostream &err, DriverContext &context) {
+  // Compiler mode input_file... -o output [options...], see `usage`
+  const std::string &prog = args[0];
+  const std::string *mode = nullptr;
+  std::vector<std::string> inputs;
+  const std::string *output = nullptr;
+  const std::string *manifest = nullptr;
+  Options opts;
+  opts.ast_sink = &out;
+  opts.err = &err;
+  // `-jN` compiles up to N units at once, all cores by default
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  // `-ftime-report[=json]` prints the cost of each phase to stderr
+  bool time_report = false;
+  bool time_report_json = false;
+  // `-dump-ast[=json]` prints the C AST to stdout, or to `-dump-ast-o file`
+  const std::string *ast_dump_output = nullptr;
+  // `-cache-dir dir` reuses outputs of identical units, see `CompileCache`
+  const std::string *cache_dir = nullptr;
+  std::uint64_t cache_size = std::uint64_t(256) << 20;
+  bool cache_stats = false;
+  std::size_t argc = args.size();
+  for (std::size_t i = 1; i < argc; i++) {
+    const std::string &arg = args[i];
+    if (arg == "-o" && i + 1 < argc) {
+      output = &args[++i];
+    } else if (arg == "-manifest" && i + 1 < argc) {
+      manifest = &args[++i];
+    } else if (arg == "-O2") {
+      opts.optimize = true;
+    } else if (arg == "-O0") {
+      opts.optimize = false;
+    } else if (arg == "-dump-ast") {
+      opts.ast_dump = AST_DUMP::TEXT;
+    } else if (arg == "-dump-ast=json") {
+      opts.ast_dump = AST_DUMP::JSON;
+    } else if (arg == "-dump-ast-o" && i + 1 < argc) {
+      ast_dump_output = &args[++i];
+    } else if (arg == "-cache-dir" && i + 1 < argc) {
+      cache_dir = &args[++i];
+    } else if (arg == "-cache-size" && i + 1 < argc) {
+      if (!parse_size(args[++i], cache_size)) {
+        return usage(prog, err);
+      }
+    } else if (arg == "-cache-stats") {
+      cache_stats = true;
+    } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+      jobs = std::max(1, std::atoi(arg.c_str() + 2));
+    } else if (arg == "-ftime-report") {
+      time_report = true;
+    } else if (arg == "-ftime-report=json") {
+      time_report = time_report_json = true;
+    } else if (!mode && arg[0] == '-') {
+      mode = &arg;
+    } else if (arg[0] != '-') {
+      inputs.push_back(resolve_path(cwd, arg));
+    } else {
+      return usage(prog, err);
+    }
+  }
+  if (!mode) {
+    return usage(prog, err);
+  }
+  if (!parse_compile_mode(*mode, opts.mode, err)) {
+    return 1;
+  }
+
+  // With several inputs `-o` names the directory the outputs are written to
+  std::vector<std::pair<std::string, std::string>> units;
+  if (manifest) {
+    if (!inputs.empty() || output) {
+      return usage(prog, err);
+    }
+    if (!read_manifest(resolve_path(cwd, *manifest), units, err)) {
+      return 1;
+    }
+    for (auto &[input, output] : units) {
+      input = resolve_path(cwd, input);
+      output = resolve_path(cwd, output);
+    }
+  } else if (inputs.size() == 1 && output) {
+    units.emplace_back(inputs[0], resolve_path(cwd, *output));
+  } else if (inputs.size() > 1 && output) {
+    std::string dir = resolve_path(cwd, *output);
+    for (auto const &input : inputs) {
+      units.emplace_back(input, output_in_dir(dir, input, opts.mode));
+    }
+  } else {
+    return usage(prog, err);
+  }
+  if (!check_distinct_outputs(units, err)) {
+    return 1;
+  }
+
+  std::ofstream ast_file;
+  if (ast_dump_output) {
+    ast_file.open(resolve_path(cwd, *ast_dump_output));
+    if (!ast_file.is_open()) {
+      err << "Unable to write to AST dump file: " << *ast_dump_output
+          << std::endl;
+      return 1;
+    }
+    opts.ast_sink = &ast_file;
+  }
+
+  CompileCache *cache = nullptr;
+  if (cache_dir) {
+    cache = &context.cache(resolve_path(cwd, *cache_dir), cache_size);
+    if (!cache->is_usable()) {
+      err << "warning: unable to use cache directory: " << *cache_dir
+          << std::endl;
+    }
+    opts.cache = cache;
+    opts.cache_settings = *mode + (opts.optimize ? " -O2" : " -O0");
+  }
+
+  std::mutex output_mutex;
+  opts.output_mutex = &output_mutex;
+
+  // Phases of all units are summed up in the report
+  TimeReport report(time_report);
+  std::atomic<std::size_t> next_unit{0};
+  std::atomic<int> failures{0};
+
+  // Each worker keeps taking the next unit until none are left
+  auto worker = [&] {
+    for (std::size_t i; (i = next_unit++) < units.size();) {
+      auto const &[input, output] = units[i];
+      bool ok;
+      try {
+        ok = compile_unit(opts, input, output, report);
+      } catch (const std::exception &e) {
+        report_error(opts, input + ": " + e.what());
+        ok = false;
+      }
+      if (!ok) {
+        failures++;
+      }
+    }
+  };
+
+  // A single unit is parallelised over its functions instead, several units
+  // already keep the cores busy
+  if (units.size() == 1) {
+    opts.codegen_jobs = jobs;
+  }
+  jobs = std::min<std::size_t>(jobs, units.size());
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < jobs; i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto &t : workers) {
+    t.join();
+  }
+
+  if (time_report_json) {
+    report.print_json(err);
+  } else if (report.is_enabled()) {
+    report.print(err);
+  }
+  if (cache) {
+    auto totals = cache->flush_stats();
+    if (cache_stats) {
+      CompileCache::print_stats(totals, err);
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "compile_cache.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// What the driver keeps warm between runs in one process, such as the runs
+// of a compile server: the cache directories that are in use.
+class DriverContext {
+private:
+  std::mutex mutex;
+  std::map<std::string, std::unique_ptr<CompileCache>> caches;
+
+public:
+  // The cache in `dir`, created on first use. A later run asking for another
+  // size limit changes it for every run.
+  CompileCache &cache(const std::string &dir, std::uint64_t max_bytes);
+};
+
+// Runs the compiler on the command line `args`, program name included, as
+// if it had been started in directory `cwd` (the current one if empty).
+// What would go to stdout and stderr goes to `out` and `err`. Returns the
+// exit status of the run.
+int run_driver(const std::vector<std::string> &args, const std::string &cwd,
+               std::ostream &out, std::ostream &err, DriverContext &context);
@@ -0,0 +1,222 @@
+#include "elf_writer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The few ELF constants needed here, so that no system header is required
+static constexpr std::uint16_t ET_REL = 1;
+static constexpr std::uint16_t EM_RISCV = 243;
+static constexpr std::uint32_t SHT_PROGBITS = 1;
+static constexpr std::uint32_t SHT_SYMTAB = 2;
+static constexpr std::uint32_t SHT_STRTAB = 3;
+static constexpr std::uint32_t SHT_RELA = 4;
+static constexpr std::uint32_t SHF_ALLOC = 0x2;
+static constexpr std::uint32_t SHF_EXECINSTR = 0x4;
+static constexpr std::uint32_t SHF_INFO_LINK = 0x40;
+static constexpr std::uint8_t STB_LOCAL = 0;
+static constexpr std::uint8_t STB_GLOBAL = 1;
+static constexpr std::uint8_t STT_FUNC = 2;
+static constexpr std::uint8_t STT_SECTION = 3;
+
+static constexpr std::uint32_t EHDR_SIZE = 52;
+static constexpr std::uint32_t SHDR_SIZE = 40;
+static constexpr std::uint32_t SYM_SIZE = 16;
+static constexpr std::uint32_t RELA_SIZE = 12;
+
+// Little-endian image of the object file
+class ByteBuffer {
+public:
+  std::vector<std::uint8_t> bytes;
+
+  std::uint32_t size() const {
+    return static_cast<std::uint32_t>(bytes.size());
+  }
+  void u8(std::uint8_t v) { bytes.push_back(v); }
+  void u16(std::uint16_t v) {
+    u8(static_cast<std::uint8_t>(v));
+    u8(static_cast<std::uint8_t>(v >> 8));
+  }
+  void u32(std::uint32_t v) {
+    u16(static_cast<std::uint16_t>(v));
+    u16(static_cast<std::uint16_t>(v >> 16));
+  }
+  void append(const void *data, std::size_t len) {
+    auto *p = static_cast<const std::uint8_t *>(data);
+    bytes.insert(bytes.end(), p, p + len);
+  }
+  void align(std::uint32_t alignment) {
+    while (bytes.size() % alignment != 0) {
+      u8(0);
+    }
+  }
+};
+
+// String table under construction, offset 0 is the empty string
+class StringTable {
+public:
+  std::string data{'\0'};
+
+  std::uint32_t add(std::string_view str) {
+    auto offset = static_cast<std::uint32_t>(data.size());
+    data.append(str);
+    data.push_back('\0');
+    return offset;
+  }
+};
+
+struct SectionHeader {
+  std::uint32_t name;
+  std::uint32_t type;
+  std::uint32_t flags;
+  std::uint32_t offset;
+  std::uint32_t size;
+  std::uint32_t link;
+  std::uint32_t info;
+  std::uint32_t align;
+  std::uint32_t entsize;
+};
+
+void write_elf_object(const ObjectCode &code, std::ostream &out) {
+  // Section indices, `.rela.text` only exists with relocations
+  const std::uint16_t text_index = 1, symtab_index = 2, strtab_index = 3;
+  const bool has_rela = !code.relocations.empty();
+  const std::uint16_t rela_index = 4;
+  const std::uint16_t shstrtab_index = has_rela ? 5 : 4;
+
+  StringTable shstrtab;
+  StringTable strtab;
+
+  // Symbols: the null symbol and the section come first, then local
+  // functions, then global ones, as ELF wants locals before globals
+  ByteBuffer symtab;
+  auto put_symbol = [&](std::uint32_t name, std::uint32_t value,
+                        std::uint32_t size, std::uint8_t bind,
+                        std::uint8_t type, std::uint16_t shndx) {
+    symtab.u32(name);
+    symtab.u32(value);
+    symtab.u32(size);
+    symtab.u8(static_cast<std::uint8_t>(bind << 4 | type));
+    symtab.u8(0);
+    symtab.u16(shndx);
+  };
+  put_symbol(0, 0, 0, STB_LOCAL, 0, 0);
+  put_symbol(0, 0, 0, STB_LOCAL, STT_SECTION, text_index);
+  std::vector<std::uint32_t> symbol_index(code.symbols.size());
+  std::uint32_t next_index = 2;
+  std::uint32_t first_global = 0;
+  for (bool global : {false, true}) {
+    if (global) {
+      first_global = next_index;
+    }
+    for (std::size_t i = 0; i < code.symbols.size(); i++) {
+      auto const &sym = code.symbols[i];
+      if (sym.global != global) {
+        continue;
+      }
+      symbol_index[i] = next_index++;
+      put_symbol(strtab.add(sym.name), sym.offset, sym.size,
+                 global ? STB_GLOBAL : STB_LOCAL, STT_FUNC, text_index);
+    }
+  }
+
+  ByteBuffer rela;
+  for (auto const &reloc : code.relocations) {
+    rela.u32(reloc.offset);
+    rela.u32(symbol_index[reloc.symbol] << 8 | (reloc.type & 0xff));
+    rela.u32(static_cast<std::uint32_t>(reloc.addend));
+  }
+
+  // `.shstrtab` names itself, so all names are added before it is placed
+  std::vector<std::uint32_t> section_names(shstrtab_index + 1, 0);
+  section_names[text_index] = shstrtab.add(".text");
+  section_names[symtab_index] = shstrtab.add(".symtab");
+  section_names[strtab_index] = shstrtab.add(".strtab");
+  if (has_rela) {
+    section_names[rela_index] = shstrtab.add(".rela.text");
+  }
+  section_names[shstrtab_index] = shstrtab.add(".shstrtab");
+
+  // Section contents follow the ELF header, the section headers come last
+  ByteBuffer image;
+  image.bytes.resize(EHDR_SIZE);
+  std::vector<SectionHeader> sections(shstrtab_index + 1, SectionHeader{});
+  auto place = [&](std::uint16_t index, std::uint32_t type, const void *data,
+                   std::size_t len, std::uint32_t align) {
+    image.align(align);
+    SectionHeader &sh = sections[index];
+    sh.name = section_names[index];
+    sh.type = type;
+    sh.offset = image.size();
+    sh.size = static_cast<std::uint32_t>(len);
+    sh.align = align;
+    image.append(data, len);
+  };
+
+  place(text_index, SHT_PROGBITS, code.text.data(), code.text.size(),
+        4);
+  sections[text_index].flags = SHF_ALLOC | SHF_EXECINSTR;
+
+  place(symtab_index, SHT_SYMTAB, symtab.bytes.data(),
+        symtab.bytes.size(), 4);
+  sections[symtab_index].link = strtab_index;
+  sections[symtab_index].info = first_global;
+  sections[symtab_index].entsize = SYM_SIZE;
+
+  place(strtab_index, SHT_STRTAB, strtab.data.data(),
+        strtab.data.size(), 1);
+
+  if (has_rela) {
+    place(rela_index, SHT_RELA, rela.bytes.data(),
+          rela.bytes.size(), 4);
+    sections[rela_index].flags = SHF_INFO_LINK;
+    sections[rela_index].link = symtab_index;
+    sections[rela_index].info = text_index;
+    sections[rela_index].entsize = RELA_SIZE;
+  }
+
+  place(shstrtab_index, SHT_STRTAB, shstrtab.data.data(),
+        shstrtab.data.size(), 1);
+
+  image.align(4);
+  std::uint32_t shoff = image.size();
+  for (auto const &sh : sections) {
+    image.u32(sh.name);
+    image.u32(sh.type);
+    image.u32(sh.flags);
+    image.u32(0); // sh_addr
+    image.u32(sh.offset);
+    image.u32(sh.size);
+    image.u32(sh.link);
+    image.u32(sh.info);
+    image.u32(sh.align);
+    image.u32(sh.entsize);
+  }
+
+  // ELF header
+  ByteBuffer ehdr;
+  const std::uint8_t ident[16] = {0x7f, 'E', 'L', 'F',
+                                  1,    // ELFCLASS32
+                                  1,    // ELFDATA2LSB
+                                  1,    // EV_CURRENT
+                                  0};   // ELFOSABI_NONE
+  ehdr.append(ident, sizeof(ident));
+  ehdr.u16(ET_REL);
+  ehdr.u16(EM_RISCV);
+  ehdr.u32(1); // e_version
+  ehdr.u32(0); // e_entry
+  ehdr.u32(0); // e_phoff
+  ehdr.u32(shoff);
+  ehdr.u32(0); // e_flags: no compressed instructions, soft-float ABI
+  ehdr.u16(EHDR_SIZE);
+  ehdr.u16(0); // e_phentsize
+  ehdr.u16(0); // e_phnum
+  ehdr.u16(SHDR_SIZE);
+  ehdr.u16(static_cast<std::uint16_t>(sections.size()));
+  ehdr.u16(shstrtab_index);
+  std::copy(ehdr.bytes.begin(), ehdr.bytes.end(), image.bytes.begin());
+
+  out.write(reinterpret_cast<const char *>(image.bytes.data()),
+            static_cast<std::streamsize>(image.bytes.size()));
+}
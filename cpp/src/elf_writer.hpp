@@ -0,0 +1,9 @@
+#pragma once
+
+#include "riscv_encoder.hpp"
+#include <ostream>
+
+// Writes `code` as a relocatable 32-bit little-endian ELF object for RISC-V,
+// with `.text`, a symbol table, and `.rela.text` if there are relocations.
+// The output links like the object the assembler makes of the assembly.
+void write_elf_object(const ObjectCode &code, std::ostream &out);
@@ -0,0 +1,15 @@
+#include "emitter.hpp"
+
+Emitter::Emitter(std::ostream &sink_) : sink(&sink_) {
+  buffer.reserve(FLUSH_THRESHOLD + 4096);
+}
+
+Emitter::~Emitter() { flush(); }
+
+void Emitter::flush() {
+  if (!sink || buffer.empty())
+    return;
+  sink->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  sink->flush();
+  buffer.clear();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "register.hpp"
+#include <charconv>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// Text output of the code generator and the IR dumps. Everything is appended
+// to one growable buffer, numbers are formatted in place with `to_chars` and
+// registers come from a static name table, so emitting a line allocates
+// nothing. The buffer goes to the sink in large chunks, and at the latest on
+// `flush()` or destruction. An emitter without a sink only collects the text,
+// for `take()`.
+class Emitter {
+private:
+  std::ostream *sink = nullptr;
+  std::string buffer;
+
+  // Hand the buffer to the sink once it has grown past this
+  static constexpr std::size_t FLUSH_THRESHOLD = 1 << 20;
+
+  void maybe_flush() {
+    if (sink && buffer.size() >= FLUSH_THRESHOLD)
+      flush();
+  }
+
+public:
+  Emitter() = default;
+  explicit Emitter(std::ostream &sink_);
+  ~Emitter();
+
+  Emitter(const Emitter &) = delete;
+  Emitter &operator=(const Emitter &) = delete;
+
+  void flush();
+
+  // Everything emitted so far, leaves the emitter empty
+  std::string take() {
+    std::string text = std::move(buffer);
+    buffer.clear();
+    return text;
+  }
+
+  Emitter &operator<<(std::string_view str) {
+    buffer.append(str);
+    maybe_flush();
+    return *this;
+  }
+
+  Emitter &operator<<(const char *str) {
+    return *this << std::string_view(str);
+  }
+
+  Emitter &operator<<(char c) {
+    buffer.push_back(c);
+    maybe_flush();
+    return *this;
+  }
+
+  Emitter &operator<<(reg_t reg) { return *this << reg.name(); }
+
+  template <class T, std::enable_if_t<std::is_integral_v<T> &&
+                                          !std::is_same_v<T, char> &&
+                                          !std::is_same_v<T, bool>,
+                                      int> = 0>
+  Emitter &operator<<(T value) {
+    char digits[24];
+    auto res = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer.append(digits, res.ptr);
+    maybe_flush();
+    return *this;
+  }
+};
@@ -0,0 +1,538 @@
+#include "logger.hpp"
+#include "regalloc.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <set>
+#include <unordered_set>
+
+namespace {
+
+// Follows "Modern Compiler Implementation", chapter 11. Nodes [0, K) are the
+// precoloured physical registers, the rest are the function's values.
+class IteratedCoalescing {
+private:
+  enum class MoveState { Worklist, Active, Coalesced, Constrained, Frozen };
+  enum class NodeState {
+    Precolored,
+    Initial,
+    Simplify,
+    Freeze,
+    Spill,
+    Spilled,
+    Coalesced,
+    Colored,
+    Select,
+  };
+
+  struct Move {
+    int dst;
+    int src;
+    MoveState state = MoveState::Worklist;
+  };
+
+  const std::vector<reg_t> &colors;
+  const int K;
+  int num_nodes;
+
+  std::unordered_set<std::uint64_t> adj_set;
+  std::vector<std::vector<int>> adj_list;
+  std::vector<int> degree;
+  std::vector<NodeState> state;
+  std::vector<int> alias;
+  std::vector<int> color;
+  std::vector<double> spill_cost;
+
+  std::vector<Move> moves;
+  std::vector<std::vector<int>> move_list;
+
+  // Ordered sets keep the allocation deterministic
+  std::set<int> simplify_worklist, freeze_worklist, spill_worklist;
+  std::set<int> worklist_moves, active_moves;
+  std::vector<int> select_stack;
+
+  static std::uint64_t edge_key(int u, int v) {
+    return (static_cast<std::uint64_t>(u) << 32) |
+           static_cast<std::uint32_t>(v);
+  }
+
+  bool is_precolored(int n) const { return n < K; }
+
+  bool adjacent(int u, int v) const { return adj_set.count(edge_key(u, v)); }
+
+  std::vector<int> adjacent_nodes(int n) const {
+    std::vector<int> ret;
+    for (int m : adj_list[n]) {
+      if (state[m] != NodeState::Select && state[m] != NodeState::Coalesced)
+        ret.push_back(m);
+    }
+    return ret;
+  }
+
+  std::vector<int> node_moves(int n) const {
+    std::vector<int> ret;
+    for (int m : move_list[n]) {
+      if (moves[m].state == MoveState::Active ||
+          moves[m].state == MoveState::Worklist)
+        ret.push_back(m);
+    }
+    return ret;
+  }
+
+  bool move_related(int n) const { return !node_moves(n).empty(); }
+
+  void push_worklist(int n) {
+    if (degree[n] >= K) {
+      state[n] = NodeState::Spill;
+      spill_worklist.insert(n);
+    } else if (move_related(n)) {
+      state[n] = NodeState::Freeze;
+      freeze_worklist.insert(n);
+    } else {
+      state[n] = NodeState::Simplify;
+      simplify_worklist.insert(n);
+    }
+  }
+
+  void enable_moves(int n) {
+    for (int m : node_moves(n)) {
+      if (moves[m].state == MoveState::Active) {
+        active_moves.erase(m);
+        moves[m].state = MoveState::Worklist;
+        worklist_moves.insert(m);
+      }
+    }
+  }
+
+  void decrement_degree(int m) {
+    if (is_precolored(m))
+      return;
+    int d = degree[m]--;
+    if (d == K) {
+      enable_moves(m);
+      for (int n : adjacent_nodes(m))
+        enable_moves(n);
+      spill_worklist.erase(m);
+      if (move_related(m)) {
+        state[m] = NodeState::Freeze;
+        freeze_worklist.insert(m);
+      } else {
+        state[m] = NodeState::Simplify;
+        simplify_worklist.insert(m);
+      }
+    }
+  }
+
+  void simplify() {
+    int n = *simplify_worklist.begin();
+    simplify_worklist.erase(simplify_worklist.begin());
+    state[n] = NodeState::Select;
+    select_stack.push_back(n);
+    for (int m : adjacent_nodes(n))
+      decrement_degree(m);
+  }
+
+  int get_alias(int n) const {
+    while (state[n] == NodeState::Coalesced)
+      n = alias[n];
+    return n;
+  }
+
+  void add_worklist(int u) {
+    if (!is_precolored(u) && !move_related(u) && degree[u] < K) {
+      freeze_worklist.erase(u);
+      state[u] = NodeState::Simplify;
+      simplify_worklist.insert(u);
+    }
+  }
+
+  // George's test for coalescing with a precoloured node
+  bool george_ok(int t, int r) const {
+    return degree[t] < K || is_precolored(t) || adjacent(t, r);
+  }
+
+  // Briggs' test
+  bool conservative(const std::vector<int> &nodes) const {
+    int k = 0;
+    for (int n : nodes) {
+      if (degree[n] >= K)
+        k++;
+    }
+    return k < K;
+  }
+
+  void combine(int u, int v) {
+    if (state[v] == NodeState::Freeze)
+      freeze_worklist.erase(v);
+    else
+      spill_worklist.erase(v);
+    state[v] = NodeState::Coalesced;
+    alias[v] = u;
+    move_list[u].insert(move_list[u].end(), move_list[v].begin(),
+                        move_list[v].end());
+    enable_moves(v);
+    for (int t : adjacent_nodes(v)) {
+      add_edge(t, u);
+      decrement_degree(t);
+    }
+    spill_cost[u] += spill_cost[v];
+    if (degree[u] >= K && state[u] == NodeState::Freeze) {
+      freeze_worklist.erase(u);
+      state[u] = NodeState::Spill;
+      spill_worklist.insert(u);
+    }
+  }
+
+  void coalesce() {
+    int m = *worklist_moves.begin();
+    worklist_moves.erase(worklist_moves.begin());
+
+    int x = get_alias(moves[m].dst);
+    int y = get_alias(moves[m].src);
+    int u = x, v = y;
+    if (is_precolored(y))
+      std::swap(u, v);
+
+    if (u == v) {
+      moves[m].state = MoveState::Coalesced;
+      add_worklist(u);
+    } else if (is_precolored(v) || adjacent(u, v)) {
+      moves[m].state = MoveState::Constrained;
+      add_worklist(u);
+      add_worklist(v);
+    } else {
+      bool ok;
+      if (is_precolored(u)) {
+        ok = true;
+        for (int t : adjacent_nodes(v))
+          ok = ok && george_ok(t, u);
+      } else {
+        auto nodes = adjacent_nodes(u);
+        auto v_nodes = adjacent_nodes(v);
+        nodes.insert(nodes.end(), v_nodes.begin(), v_nodes.end());
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        ok = conservative(nodes);
+      }
+
+      if (ok) {
+        moves[m].state = MoveState::Coalesced;
+        combine(u, v);
+        add_worklist(u);
+      } else {
+        moves[m].state = MoveState::Active;
+        active_moves.insert(m);
+      }
+    }
+  }
+
+  void freeze_moves(int u) {
+    for (int m : node_moves(u)) {
+      int x = moves[m].dst, y = moves[m].src;
+      int v = get_alias(y) == get_alias(u) ? get_alias(x) : get_alias(y);
+      active_moves.erase(m);
+      worklist_moves.erase(m);
+      moves[m].state = MoveState::Frozen;
+      if (!is_precolored(v) && !move_related(v) && degree[v] < K) {
+        freeze_worklist.erase(v);
+        state[v] = NodeState::Simplify;
+        simplify_worklist.insert(v);
+      }
+    }
+  }
+
+  void freeze() {
+    int u = *freeze_worklist.begin();
+    freeze_worklist.erase(freeze_worklist.begin());
+    state[u] = NodeState::Simplify;
+    simplify_worklist.insert(u);
+    freeze_moves(u);
+  }
+
+  void select_spill() {
+    // Cheapest to spill relative to how many neighbours it frees up
+    int best = -1;
+    double best_ratio = 0;
+    for (int n : spill_worklist) {
+      double ratio = spill_cost[n] / std::max(degree[n], 1);
+      if (best == -1 || ratio < best_ratio) {
+        best = n;
+        best_ratio = ratio;
+      }
+    }
+    spill_worklist.erase(best);
+    state[best] = NodeState::Simplify;
+    simplify_worklist.insert(best);
+    freeze_moves(best);
+  }
+
+  void assign_colors() {
+    while (!select_stack.empty()) {
+      int n = select_stack.back();
+      select_stack.pop_back();
+
+      std::vector<bool> ok(K, true);
+      for (int w : adj_list[n]) {
+        int a = get_alias(w);
+        if (state[a] == NodeState::Colored || state[a] == NodeState::Precolored)
+          ok[color[a]] = false;
+      }
+
+      // Colours are ordered caller-saved first, which cost nothing to use
+      auto it = std::find(ok.begin(), ok.end(), true);
+      if (it == ok.end()) {
+        state[n] = NodeState::Spilled;
+      } else {
+        state[n] = NodeState::Colored;
+        color[n] = static_cast<int>(it - ok.begin());
+      }
+    }
+    for (int n = K; n < num_nodes; n++) {
+      if (state[n] == NodeState::Coalesced) {
+        int a = get_alias(n);
+        if (state[a] == NodeState::Spilled) {
+          state[n] = NodeState::Spilled;
+        } else {
+          state[n] = NodeState::Colored;
+          color[n] = color[a];
+        }
+      }
+    }
+  }
+
+public:
+  IteratedCoalescing(const std::vector<reg_t> &colors_, int num_values)
+      : colors(colors_), K(static_cast<int>(colors_.size())),
+        num_nodes(K + num_values), adj_list(num_nodes), degree(num_nodes, 0),
+        state(num_nodes, NodeState::Initial), alias(num_nodes, -1),
+        color(num_nodes, -1), spill_cost(num_nodes, 0), move_list(num_nodes) {
+    for (int i = 0; i < K; i++) {
+      state[i] = NodeState::Precolored;
+      color[i] = i;
+      degree[i] = INT32_MAX / 2;
+    }
+  }
+
+  void add_edge(int u, int v) {
+    if (u == v || adjacent(u, v))
+      return;
+    adj_set.insert(edge_key(u, v));
+    adj_set.insert(edge_key(v, u));
+    if (!is_precolored(u)) {
+      adj_list[u].push_back(v);
+      degree[u]++;
+    }
+    if (!is_precolored(v)) {
+      adj_list[v].push_back(u);
+      degree[v]++;
+    }
+  }
+
+  void add_move(int dst, int src) {
+    int m = static_cast<int>(moves.size());
+    moves.push_back({dst, src});
+    move_list[dst].push_back(m);
+    move_list[src].push_back(m);
+    worklist_moves.insert(m);
+  }
+
+  void add_spill_cost(int n, double cost) { spill_cost[n] += cost; }
+
+  void run() {
+    for (int n = K; n < num_nodes; n++)
+      push_worklist(n);
+
+    while (!simplify_worklist.empty() || !worklist_moves.empty() ||
+           !freeze_worklist.empty() || !spill_worklist.empty()) {
+      if (!simplify_worklist.empty())
+        simplify();
+      else if (!worklist_moves.empty())
+        coalesce();
+      else if (!freeze_worklist.empty())
+        freeze();
+      else
+        select_spill();
+    }
+
+    assign_colors();
+  }
+
+  // The colour index of the node, or -1 if it was spilled
+  int color_of(int n) const {
+    return state[n] == NodeState::Colored ? color[n] : -1;
+  }
+};
+
+// Loop nesting depth of each block, from the natural loops of back edges
+std::unordered_map<koopa_raw_basic_block_t, int>
+compute_loop_depth(koopa_raw_function_t func, const LivenessInfo &liveness) {
+  std::unordered_map<koopa_raw_basic_block_t, int> depth;
+  if (func->bbs.len == 0)
+    return depth;
+
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::vector<koopa_raw_basic_block_t>>
+      preds;
+  for (auto const &[bb, succs] : liveness.successors) {
+    for (auto succ : succs)
+      preds[succ].push_back(bb);
+  }
+
+  auto succs_of = [&](koopa_raw_basic_block_t bb) {
+    auto it = liveness.successors.find(bb);
+    return it == liveness.successors.end()
+               ? std::vector<koopa_raw_basic_block_t>{}
+               : it->second;
+  };
+
+  // Iterative DFS, an edge to a block still on the stack is a back edge
+  auto entry = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+  std::unordered_set<koopa_raw_basic_block_t> visited, on_stack;
+  std::vector<std::pair<koopa_raw_basic_block_t, size_t>> stack;
+  std::vector<std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>>
+      back_edges;
+
+  stack.push_back({entry, 0});
+  visited.insert(entry);
+  on_stack.insert(entry);
+  while (!stack.empty()) {
+    auto &[bb, idx] = stack.back();
+    auto succs = succs_of(bb);
+    if (idx < succs.size()) {
+      auto succ = succs[idx++];
+      if (on_stack.count(succ)) {
+        back_edges.push_back({bb, succ});
+      } else if (!visited.count(succ)) {
+        visited.insert(succ);
+        on_stack.insert(succ);
+        stack.push_back({succ, 0});
+      }
+    } else {
+      on_stack.erase(bb);
+      stack.pop_back();
+    }
+  }
+
+  // Every block of a natural loop reaches the latch without the header
+  for (auto [latch, header] : back_edges) {
+    std::unordered_set<koopa_raw_basic_block_t> body = {header};
+    std::vector<koopa_raw_basic_block_t> work;
+    if (body.insert(latch).second)
+      work.push_back(latch);
+    while (!work.empty()) {
+      auto bb = work.back();
+      work.pop_back();
+      for (auto pred : preds[bb]) {
+        if (body.insert(pred).second)
+          work.push_back(pred);
+      }
+    }
+    for (auto bb : body)
+      depth[bb]++;
+  }
+
+  return depth;
+}
+
+} // namespace
+
+Allocation
+GraphColoringAllocator::allocate(koopa_raw_function_t func) const {
+  Allocation alloc;
+  LivenessInfo liveness = LivenessInfo::compute(func);
+  alloc.has_calls = !liveness.calls.empty();
+
+  std::vector<reg_t> colors = CALLER_SAVED_REGISTERS;
+  colors.insert(colors.end(), CALLEE_SAVED_REGISTERS.begin(),
+                CALLEE_SAVED_REGISTERS.end());
+  const int K = static_cast<int>(colors.size());
+  const int caller_saved = static_cast<int>(CALLER_SAVED_REGISTERS.size());
+  const int a0 = static_cast<int>(
+      std::find(colors.begin(), colors.end(), reg_t{'a', 0}) - colors.begin());
+
+  std::unordered_map<koopa_raw_value_t, int> node;
+  for (auto const &interval : liveness.intervals)
+    node.emplace(interval.value, K + static_cast<int>(node.size()));
+
+  IteratedCoalescing graph(colors, static_cast<int>(node.size()));
+  auto loop_depth = compute_loop_depth(func, liveness);
+
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    double weight = std::pow(10.0, loop_depth[bb]);
+
+    // Values without a node (defined outside the body) take no part
+    std::unordered_set<int> live;
+    for (auto v : liveness.live_out[bb]) {
+      auto it = node.find(v);
+      if (it != node.end())
+        live.insert(it->second);
+    }
+
+    // Walk backwards, every definition interferes with what is live after it
+    for (uint32_t j = bb->insts.len; j-- > 0;) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+
+      std::vector<int> uses;
+      for_each_operand(inst, [&](koopa_raw_value_t operand) {
+        auto it = node.find(operand);
+        if (it != node.end())
+          uses.push_back(it->second);
+      });
+      for (int u : uses)
+        graph.add_spill_cost(u, weight);
+
+      std::vector<int> defs;
+      auto it = node.find(inst);
+      if (it != node.end()) {
+        defs.push_back(it->second);
+        graph.add_spill_cost(it->second, weight);
+      }
+
+      // `ret v` is lowered as `mv a0, v`
+      bool is_move = inst->kind.tag == KOOPA_RVT_RETURN && uses.size() == 1;
+      if (is_move) {
+        live.erase(uses[0]);
+        defs.push_back(a0);
+        graph.add_move(a0, uses[0]);
+      }
+      // Calls clobber every caller-saved register
+      if (inst->kind.tag == KOOPA_RVT_CALL) {
+        for (int r = 0; r < caller_saved; r++)
+          defs.push_back(r);
+      }
+
+      for (int d : defs) {
+        for (int l : live)
+          graph.add_edge(l, d);
+      }
+      for (int d : defs)
+        live.erase(d);
+      for (int u : uses)
+        live.insert(u);
+    }
+  }
+
+  graph.run();
+
+  std::uint32_t slot = 0;
+  for (auto const &interval : liveness.intervals) {
+    auto it = node.find(interval.value);
+    int c = it == node.end() ? -1 : graph.color_of(it->second);
+    if (c < 0) {
+      alloc.locations[interval.value] = Location{
+          Location::Kind::Stack, {}, static_cast<std::int32_t>(4 * slot++)};
+      continue;
+    }
+    reg_t reg = colors[c];
+    alloc.locations[interval.value] =
+        Location{Location::Kind::Register, reg, 0};
+    if (c >= caller_saved &&
+        std::find(alloc.callee_saved.begin(), alloc.callee_saved.end(), reg) ==
+            alloc.callee_saved.end())
+      alloc.callee_saved.push_back(reg);
+  }
+  alloc.spill_slots = slot;
+
+  return alloc;
+}
@@ -4,26 +4,104 @@
 
 #include "c_ast.hpp"
 #include "koopa_ast.hpp"
+#include <cstdint>
+#include <functional>
 #include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Builds the instructions of one basic block.
+ *
+ * Constants are hash-consed, and binary instructions are numbered by their
+ * operator and operands (local value numbering): an expression the block
+ * computed before is reused instead of emitted again. `a op b` and `b op a`
+ * get the same number when `op` commutes, as do `a < b` and `b > a`.
+ */
+class BlockBuilder {
+public:
+  explicit BlockBuilder(koopa_ast::BasicBlock &block_) : block(block_) {}
+
+  koopa_ast::Integer *integer(std::int32_t val);
+  koopa_ast::Value *binary(koopa_ast::BinaryOp op, koopa_ast::Value *lhs,
+                           koopa_ast::Value *rhs);
+  koopa_ast::Return *ret(koopa_ast::Value *val);
+
+private:
+  // `lhs op rhs` in a canonical form
+  struct BinaryKey {
+    koopa_ast::BinaryOp op;
+    const koopa_ast::Value *lhs;
+    const koopa_ast::Value *rhs;
+
+    bool operator==(const BinaryKey &other) const {
+      return op == other.op && lhs == other.lhs && rhs == other.rhs;
+    }
+  };
+  struct BinaryKeyHash {
+    std::size_t operator()(const BinaryKey &key) const {
+      std::size_t h = std::hash<int>()(static_cast<int>(key.op));
+      h = h * 31 + std::hash<const void *>()(key.lhs);
+      return h * 31 + std::hash<const void *>()(key.rhs);
+    }
+  };
+
+  koopa_ast::BasicBlock &block;
+  std::unordered_map<std::int32_t, koopa_ast::Integer *> integers;
+  std::unordered_map<BinaryKey, koopa_ast::Binary *, BinaryKeyHash> binaries;
+};
+
+koopa_ast::Integer *BlockBuilder::integer(std::int32_t val) {
+  auto &integer = integers[val];
+  if (!integer)
+    integer = block.Make<koopa_ast::Integer>(false, val);
+  return integer;
+}
+
+koopa_ast::Value *BlockBuilder::binary(koopa_ast::BinaryOp op,
+                                       koopa_ast::Value *lhs,
+                                       koopa_ast::Value *rhs) {
+  // `a > b` is numbered as `b < a`, and the operands of a commutative
+  // operator are ordered. Only the key is reordered, a new instruction
+  // keeps its operands as written.
+  BinaryKey key{op, lhs, rhs};
+  if (op == koopa_ast::BinaryOp::Gt) {
+    key = {koopa_ast::BinaryOp::Lt, rhs, lhs};
+  } else if (op == koopa_ast::BinaryOp::Ge) {
+    key = {koopa_ast::BinaryOp::Le, rhs, lhs};
+  } else if (koopa_ast::is_commutative(op) &&
+             std::less<const koopa_ast::Value *>()(rhs, lhs)) {
+    std::swap(key.lhs, key.rhs);
+  }
+
+  auto &binary = binaries[key];
+  if (!binary)
+    binary = block.Make<koopa_ast::Binary>(true, op, lhs, rhs);
+  return binary;
+}
+
+koopa_ast::Return *BlockBuilder::ret(koopa_ast::Value *val) {
+  return block.Make<koopa_ast::Return>(true, val);
+}
 
 std::unique_ptr<koopa_ast::Program>
 translate_comp_unit_c_ast(const c_ast::CompUnitAST &);
 std::unique_ptr<koopa_ast::Function>
-translate_func_def_c_ast(const c_ast::FuncDefAST &);
+translate_func_def_c_ast(const c_ast::FuncDefAST &, SymbolTable &);
 std::unique_ptr<koopa_ast::Type>
 translate_func_type_c_ast(const c_ast::FuncTypeAST &);
 std::unique_ptr<koopa_ast::BasicBlock>
-translate_block_c_ast(const c_ast::BlockAST &block, std::string = "");
+translate_block_c_ast(const c_ast::BlockAST &block, Symbol = {});
 koopa_ast::Value *translate_stmt_c_ast(const c_ast::StmtAST &,
-                                       koopa_ast::BasicBlock &);
+                                       BlockBuilder &);
 koopa_ast::Value *translate_exp_c_ast(const c_ast::ExpAST &,
-                                      koopa_ast::BasicBlock &);
-koopa_ast::Value *translate_primary_exp_c_ast(const c_ast::PrimaryAST &,
-                                              koopa_ast::BasicBlock &);
-koopa_ast::Value *translate_unary_exp_c_ast(const c_ast::UnaryExpAST &,
-                                            koopa_ast::BasicBlock &);
+                                      BlockBuilder &);
+koopa_ast::Value *translate_exp_chain_c_ast(const c_ast::BaseAST &,
+                                            BlockBuilder &);
+koopa_ast::Value *translate_unary_op_c_ast(c_ast::UnaryOp, koopa_ast::Value *,
+                                           BlockBuilder &);
 koopa_ast::Integer *translate_number_c_ast(const c_ast::NumberAST &,
-                                           koopa_ast::BasicBlock &);
+                                           BlockBuilder &);
 
 /*******************************************************************************
  *  Implementation Details for going from each C AST nodes to Koopa Node.      *
@@ -34,99 +112,116 @@ koopa_ast::Integer *translate_number_c_ast(const c_ast::NumberAST &,
  */
 // std::unique_ptr<koopa_ast::Integer>
 koopa_ast::Integer *translate_number_c_ast(const c_ast::NumberAST &number,
-                                           koopa_ast::BasicBlock &block) {
-  auto *ret = block.Make<koopa_ast::Integer>(false, number.int_val);
-  return ret;
+                                           BlockBuilder &block) {
+  return block.integer(number.int_val);
 }
 
-koopa_ast::Value *translate_primary_exp_c_ast(const c_ast::PrimaryAST &primary,
-                                              koopa_ast::BasicBlock &block) {
-  if (auto *p = dynamic_cast<const c_ast::PrimaryASTExp *>(&primary)) {
-    auto *exp = dynamic_cast<const c_ast::ExpAST *>(p->exp.get());
-    if (!exp)
-      throw std::runtime_error("ir_builder error: PrimaryASTExp expects "
-                               "ExpAST at param `exp`");
-
-    return translate_exp_c_ast(*exp, block);
-  } else if (auto *p_num =
-                 dynamic_cast<const c_ast::PrimaryASTNumber *>(&primary)) {
-    auto *num = dynamic_cast<const c_ast::NumberAST *>(p_num->number.get());
-    if (!num)
-      throw std::runtime_error(
-          "ir_builder error: PrimaryASTNumber expects NumberAST at param "
-          "`number`");
-    return block.Make<koopa_ast::Integer>(false, num->int_val);
-  } else {
-    throw std::runtime_error(
-        "ir_builder error: PrimaryAST must have one of the following "
-        "implementation: {PrimaryASTExp, PrimaryASTNumber} ");
+/**
+ * Emitting the instruction(s) for applying a unary operator to an already
+ * translated operand.
+ */
+koopa_ast::Value *translate_unary_op_c_ast(c_ast::UnaryOp unary_op,
+                                           koopa_ast::Value *operand,
+                                           BlockBuilder &block) {
+  // Generate the instruction based on the operation type
+  switch (unary_op) {
+  case c_ast::UnaryOp::PLUS: {
+    return operand;
+  }
+  case c_ast::UnaryOp::MINUS: {
+    return block.binary(koopa_ast::BinaryOp::Sub, block.integer(0), operand);
+  }
+  case c_ast::UnaryOp::BANG: {
+    return block.binary(koopa_ast::BinaryOp::Eq, operand, block.integer(0));
   }
+  case c_ast::UnaryOp::TILDE: {
+    return block.binary(koopa_ast::BinaryOp::Xor, operand, block.integer(-1));
+  }
+  }
+  throw std::runtime_error("ir_builder error: unknown unary operator");
 }
 
-koopa_ast::Value *translate_unary_exp_c_ast(const c_ast::UnaryExpAST &unary,
-                                            koopa_ast::BasicBlock &block) {
-
-  if (auto *p = dynamic_cast<const c_ast::UnaryExpASTPrimary *>(&unary)) {
-
-    auto *prim = dynamic_cast<const c_ast::PrimaryAST *>(p->primary_exp.get());
-    if (!prim)
-      throw std::runtime_error("ir_builder error: UnaryExpASTPrimary expects "
-                               "PrimaryAST at param `primary_exp`");
-    return translate_primary_exp_c_ast(*prim, block);
-  } else if (auto *op =
-                 dynamic_cast<const c_ast::UnaryExpASTOpUnary *>(&unary)) {
-
-    auto *u_exp = dynamic_cast<const c_ast::UnaryExpAST *>(op->unary_exp.get());
-
-    if (!u_exp)
-      throw std::runtime_error("ir_builder error: UnaryExpASTOpUnary expects "
-                               "UnaryExpAST at param `unary_exp`");
-
-    auto *u_exp_ast = translate_unary_exp_c_ast(*u_exp, block);
-
-    // Generate the instruction based on the operation type
-    switch (op->unary_op) {
-    case c_ast::UnaryOp::PLUS: {
-      return u_exp_ast;
+/**
+ * Going from any expression node (ExpAST, UnaryExpAST or PrimaryAST) to the
+ * koopa value holding its result.
+ *
+ * NOTE: Expressions can be nested arbitrarily deep by machine generated
+ * sources, e.g. `- - - ... 1` or `((((...))))`, so this walks down the chain
+ * with a loop and keeps the pending unary operators on an explicit stack
+ * rather than recursing once per level.
+ */
+koopa_ast::Value *translate_exp_chain_c_ast(const c_ast::BaseAST &root,
+                                            BlockBuilder &block) {
+  std::vector<c_ast::UnaryOp> pending_ops;
+  const c_ast::BaseAST *node = &root;
+  koopa_ast::Value *value = nullptr;
+
+  while (!value) {
+    switch (node->kind) {
+    case c_ast::ASTKind::Exp: {
+      auto &exp = static_cast<const c_ast::ExpAST &>(*node);
+      node = c_ast::ast_cast<c_ast::UnaryExpAST>(exp.unary_exp);
+      if (!node)
+        throw std::runtime_error("ir_builder error: ExpAST expects "
+                                 "UnaryExpAST at param `unary_exp`");
       break;
     }
-    case c_ast::UnaryOp::MINUS: {
-      auto *zero = block.Make<koopa_ast::Integer>(false, 0);
-      auto *inst = block.Make<koopa_ast::Binary>(true, koopa_ast::BinaryOp::Sub,
-                                                 zero, u_exp_ast);
-      return inst;
+    case c_ast::ASTKind::UnaryExpOpUnary: {
+      auto &op = static_cast<const c_ast::UnaryExpASTOpUnary &>(*node);
+      pending_ops.push_back(op.unary_op);
+      node = c_ast::ast_cast<c_ast::UnaryExpAST>(op.unary_exp);
+      if (!node)
+        throw std::runtime_error("ir_builder error: UnaryExpASTOpUnary expects "
+                                 "UnaryExpAST at param `unary_exp`");
       break;
     }
-    case c_ast::UnaryOp::BANG: {
-      auto *zero = block.Make<koopa_ast::Integer>(false, 0);
-      auto *inst = block.Make<koopa_ast::Binary>(true, koopa_ast::BinaryOp::Eq,
-                                                 u_exp_ast, zero);
-      return inst;
+    case c_ast::ASTKind::UnaryExpPrimary: {
+      auto &p = static_cast<const c_ast::UnaryExpASTPrimary &>(*node);
+      node = c_ast::ast_cast<c_ast::PrimaryAST>(p.primary_exp);
+      if (!node)
+        throw std::runtime_error("ir_builder error: UnaryExpASTPrimary expects "
+                                 "PrimaryAST at param `primary_exp`");
       break;
     }
-    case c_ast::UnaryOp::TILDE: {
-      auto *all_one = block.Make<koopa_ast::Integer>(false, -1);
-      auto *inst = block.Make<koopa_ast::Binary>(true, koopa_ast::BinaryOp::Xor,
-                                                 u_exp_ast, all_one);
-      return inst;
+    case c_ast::ASTKind::PrimaryExp: {
+      // Parentheses only group, they do not produce any instruction
+      auto &p = static_cast<const c_ast::PrimaryASTExp &>(*node);
+      node = c_ast::ast_cast<c_ast::ExpAST>(p.exp);
+      if (!node)
+        throw std::runtime_error("ir_builder error: PrimaryASTExp expects "
+                                 "ExpAST at param `exp`");
       break;
     }
+    case c_ast::ASTKind::PrimaryNumber: {
+      auto &p_num = static_cast<const c_ast::PrimaryASTNumber &>(*node);
+      auto *num = c_ast::ast_cast<c_ast::NumberAST>(p_num.number);
+      if (!num)
+        throw std::runtime_error(
+            "ir_builder error: PrimaryASTNumber expects NumberAST at param "
+            "`number`");
+      value = translate_number_c_ast(*num, block);
+      break;
+    }
+    default:
+      throw std::runtime_error(
+          "ir_builder error: expression must be one of the following: "
+          "{ExpAST, UnaryExpASTPrimary, UnaryExpASTOpUnary, PrimaryASTExp, "
+          "PrimaryASTNumber} ");
     }
-  } else {
-    throw std::runtime_error(
-        "ir_builder error: UnaryExpAST must have one of the following "
-        "implementation: {UnaryExpASTPrimary, UnaryExpASTOpUnary} ");
   }
+
+  // The innermost operator applies first
+  while (!pending_ops.empty()) {
+    value = translate_unary_op_c_ast(pending_ops.back(), value, block);
+    pending_ops.pop_back();
+  }
+
+  return value;
 }
 
 koopa_ast::Value *translate_exp_c_ast(const c_ast::ExpAST &exp,
-                                      koopa_ast::BasicBlock &block) {
-  auto *unary_exp =
-      dynamic_cast<const c_ast::UnaryExpAST *>(exp.unary_exp.get());
-  if (!unary_exp)
-    throw std::runtime_error(
-        "ir_builder error: ExpAST expects UnaryExpAST at param `unary_exp`");
-  return translate_unary_exp_c_ast(*unary_exp, block);
+                                      BlockBuilder &block) {
+  return translate_exp_chain_c_ast(exp, block);
 }
 
 /**
@@ -134,9 +229,9 @@ koopa_ast::Value *translate_exp_c_ast(const c_ast::ExpAST &exp,
  *
  */
 koopa_ast::Value *translate_stmt_c_ast(const c_ast::StmtAST &stmt,
-                                       koopa_ast::BasicBlock &block) {
+                                       BlockBuilder &block) {
   // Cast and check that it has the correct type
-  auto *exp = dynamic_cast<const c_ast::ExpAST *>(stmt.exp.get());
+  auto *exp = c_ast::ast_cast<c_ast::ExpAST>(stmt.exp);
   if (!exp)
     throw std::runtime_error(
         "ir_builder error: StmtAST expects ExpAST at param `exp`");
@@ -144,7 +239,7 @@ koopa_ast::Value *translate_stmt_c_ast(const c_ast::StmtAST &stmt,
   // Translate the expression inside the return
   auto *val = translate_exp_c_ast(*exp, block);
 
-  return block.Make<koopa_ast::Return>(true, val);
+  return block.ret(val);
 }
 
 /**
@@ -165,15 +260,16 @@ translate_func_type_c_ast(const c_ast::FuncTypeAST &func_type) {
  * NOTE: The meaning of a block in C and a block in koopa is different.
  */
 std::unique_ptr<koopa_ast::BasicBlock>
-translate_block_c_ast(const c_ast::BlockAST &block, std::string name) {
+translate_block_c_ast(const c_ast::BlockAST &block, Symbol name) {
   auto ret = std::make_unique<koopa_ast::BasicBlock>(name);
+  BlockBuilder builder(*ret);
 
-  auto *stmt = dynamic_cast<const c_ast::StmtAST *>(block.stmt.get());
+  auto *stmt = c_ast::ast_cast<c_ast::StmtAST>(block.stmt);
   if (!stmt)
     throw std::runtime_error(
         "ir_builder error: BlockAST expects to have StmtAST at param `stmt`");
 
-  translate_stmt_c_ast(*stmt, *ret.get());
+  translate_stmt_c_ast(*stmt, builder);
 
   return ret;
 }
@@ -185,7 +281,7 @@ translate_block_c_ast(const c_ast::BlockAST &block, std::string name) {
  * ```
  *
  *  c_ast::FuncDefAST:name (string)
- *    -> koopa_ast::Function:name (string)
+ *    -> koopa_ast::Function:name (symbol of "@" + name)
  *
  *  c_ast::FuncDefAST:type (string)
  *    -> koopa_ast::Function:type (koopa_ast::Type)
@@ -201,15 +297,16 @@ translate_block_c_ast(const c_ast::BlockAST &block, std::string name) {
  * be the most optimised way to write this, of course.
  */
 std::unique_ptr<koopa_ast::Function>
-translate_func_def_c_ast(const c_ast::FuncDefAST &func_def) {
+translate_func_def_c_ast(const c_ast::FuncDefAST &func_def,
+                         SymbolTable &symbols) {
   auto ret = std::make_unique<koopa_ast::Function>();
 
   // Get the function name
-  ret->name = "@" + func_def.ident;
+  ret->name = symbols.intern("@", func_def.ident);
 
   // Get the type
   auto *type =
-      dynamic_cast<const c_ast::FuncTypeAST *>(func_def.func_type.get());
+      c_ast::ast_cast<c_ast::FuncTypeAST>(func_def.func_type);
   if (!type) {
     throw std::runtime_error("ir_builder error: FuncDefAST expects "
                              "FuncTypeAST at param `func_type`");
@@ -218,14 +315,15 @@ translate_func_def_c_ast(const c_ast::FuncDefAST &func_def) {
   ret->type = translate_func_type_c_ast(*type);
 
   // Get the block
-  auto *block = dynamic_cast<const c_ast::BlockAST *>(func_def.block.get());
+  auto *block = c_ast::ast_cast<c_ast::BlockAST>(func_def.block);
   if (!block) {
     throw std::runtime_error(
         "ir_builder error: FuncDefAST expects BlockAST at param `block`");
   }
 
   // HACK: We only have one block for now.
-  ret->basicblocks.push_back(translate_block_c_ast(*block, "%entry"));
+  ret->basicblocks.push_back(
+      translate_block_c_ast(*block, symbols.intern("%entry")));
 
   return ret;
 }
@@ -238,13 +336,13 @@ translate_comp_unit_c_ast(const c_ast::CompUnitAST &comp_unit) {
   auto ret = std::make_unique<koopa_ast::Program>();
 
   auto *func_def =
-      dynamic_cast<const c_ast::FuncDefAST *>(comp_unit.func_def.get());
+      c_ast::ast_cast<c_ast::FuncDefAST>(comp_unit.func_def);
   if (!func_def) {
     throw std::runtime_error(
         "ir_builder error: CompUnitAST expects FuncDefAST at param `func_def`");
   }
 
-  ret->functions.push_back(translate_func_def_c_ast(*func_def));
+  ret->functions.push_back(translate_func_def_c_ast(*func_def, ret->symbols));
 
   return ret;
 }
@@ -253,8 +351,8 @@ translate_comp_unit_c_ast(const c_ast::CompUnitAST &comp_unit) {
  * Exposed API for converting from C AST to Koopa Representation
  */
 std::unique_ptr<koopa_ast::Program>
-convert_to_custom_koopa_from_c_reps(std::unique_ptr<c_ast::BaseAST> ast) {
-  auto *comp_unit = dynamic_cast<const c_ast::CompUnitAST *>(ast.get());
+convert_to_custom_koopa_from_c_reps(const c_ast::BaseAST &ast) {
+  auto *comp_unit = c_ast::ast_cast<c_ast::CompUnitAST>(&ast);
 
   if (!comp_unit) {
     throw std::runtime_error(
@@ -3,4 +3,4 @@
 #include <memory>
 
 std::unique_ptr<koopa_ast::Program>
-convert_to_custom_koopa_from_c_reps(std::unique_ptr<c_ast::BaseAST> ast);
+convert_to_custom_koopa_from_c_reps(const c_ast::BaseAST &ast);
@@ -1,7 +1,4 @@
 #include "koopa_ast.hpp"
-#include "name_manager.hpp"
-#include <iostream>
-#include <ostream>
 #include <stdexcept>
 #include <string>
 
@@ -9,7 +6,7 @@ static constexpr const std::string_view INDENT = "\t";
 
 namespace koopa_ast {
 
-std::string get_binary_op_repr(const BinaryOp &op) {
+std::string_view get_binary_op_repr(const BinaryOp &op) {
   switch (op) {
   case BinaryOp::NotEq:
     return "ne";
@@ -48,32 +45,55 @@ std::string get_binary_op_repr(const BinaryOp &op) {
   }
 }
 
-struct ctx {
-  VarNameManager name_manager;
-} current_ctx;
+bool is_commutative(BinaryOp op) {
+  switch (op) {
+  case BinaryOp::NotEq:
+  case BinaryOp::Eq:
+  case BinaryOp::Add:
+  case BinaryOp::Mul:
+  case BinaryOp::And:
+  case BinaryOp::Or:
+  case BinaryOp::Xor:
+    return true;
+  default:
+    return false;
+  }
+}
 
-// Definition of `get_reprs` methods
+// Definition of `DumpRef` methods
 
-std::string Integer::get_reprs() {
-  this->name = std::to_string(this->val_);
-  return *this->name;
-}
+void Integer::DumpRef(Emitter &out) { out << this->val_; }
 
-std::string Return::get_reprs() {
+void Return::DumpRef(Emitter &out) {
   throw std::runtime_error(
       "Return statement do not have names / representations.");
 }
 
-std::string Binary::get_reprs() {
-  if (!this->name) {
-    this->name = current_ctx.name_manager.get_new_var_name();
+void Binary::DumpRef(Emitter &out) {
+  if (this->id == NO_ID) {
+    throw std::runtime_error(
+        "Binary instruction is used outside of the function that numbers it.");
+  }
+  out << '%' << this->id;
+}
+
+// Numbering of values
+
+void Function::number_values() {
+  std::uint32_t next_id = 0;
+  for (auto const &bb : basicblocks) {
+    if (!bb)
+      continue;
+    for (auto *inst : bb->insts) {
+      if (inst && inst->kind() == ValueKind::Binary)
+        inst->id = next_id++;
+    }
   }
-  return *this->name;
 }
 
 // Definition of Dump methods
 
-void Type::Dump(std::ostream &out) {
+void Type::Dump(Emitter &out, const SymbolTable &) {
   switch (type) {
   case koopa_ast::TypeKind::I32:
     out << "i32";
@@ -84,37 +104,46 @@ void Type::Dump(std::ostream &out) {
   }
 }
 
-void Integer::Dump(std::ostream &out) { out << this->val_; }
+void Integer::Dump(Emitter &out, const SymbolTable &) { out << this->val_; }
 
-void Return::Dump(std::ostream &out) {
+void Return::Dump(Emitter &out, const SymbolTable &) {
   // If we are returning an immediate, then return it directly
-  out << INDENT << "ret " << this->return_val->get_reprs() << std::endl;
+  out << INDENT << "ret ";
+  this->return_val->DumpRef(out);
+  out << '\n';
 }
 
-void Binary::Dump(std::ostream &out) {
-  out << INDENT << this->get_reprs() << " = " << get_binary_op_repr(this->op)
-      << " " << this->lhs->get_reprs() << ", " << this->rhs->get_reprs()
-      << std::endl;
+void Binary::Dump(Emitter &out, const SymbolTable &) {
+  out << INDENT;
+  this->DumpRef(out);
+  out << " = " << get_binary_op_repr(this->op) << " ";
+  this->lhs->DumpRef(out);
+  out << ", ";
+  this->rhs->DumpRef(out);
+  out << '\n';
 }
 
-void BasicBlock::Dump(std::ostream &out) {
-  if (!this->name.empty()) {
-    out << this->name << ":\n";
+void BasicBlock::Dump(Emitter &out, const SymbolTable &symbols) {
+  if (this->name.valid()) {
+    out << symbols.name(this->name) << ":\n";
   }
 
   for (auto const &v : this->insts) {
     if (v)
-      v->Dump(out);
+      v->Dump(out, symbols);
   }
 }
 
-void Function::Dump(std::ostream &out) {
-  out << "fun " << name << "(): ";
-  type->Dump(out);
+void Function::Dump(Emitter &out, const SymbolTable &symbols) {
+  // Renumbered on every dump, passes may have added or removed instructions
+  number_values();
+
+  out << "fun " << symbols.name(name) << "(): ";
+  type->Dump(out, symbols);
   out << " {\n";
   for (size_t i = 0; i < basicblocks.size(); ++i) {
     if (basicblocks[i])
-      basicblocks[i]->Dump(out);
+      basicblocks[i]->Dump(out, symbols);
 
     if (i + 1 < basicblocks.size())
       out << "\n";
@@ -122,14 +151,14 @@ void Function::Dump(std::ostream &out) {
   out << "}\n";
 }
 
-void Program::Dump(std::ostream &out) {
+void Program::Dump(Emitter &out, const SymbolTable &symbols) {
   for (auto const &gv : global_values) {
     if (gv)
-      gv->Dump(out);
+      gv->Dump(out, symbols);
   }
   for (auto const &f : functions) {
     if (f)
-      f->Dump(out);
+      f->Dump(out, symbols);
   }
 }
 
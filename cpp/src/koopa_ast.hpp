@@ -1,10 +1,12 @@
 #pragma once
 
+#include "emitter.hpp"
 #include "koopa.h"
+#include "symbol_table.hpp"
 #include <cstdint>
 #include <memory>
-#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace koopa_ast {
@@ -18,7 +20,8 @@ class Base {
 public:
   virtual ~Base() = default;
 
-  virtual void Dump(std::ostream &out) = 0;
+  // Names are printed from the unit's symbol table
+  virtual void Dump(Emitter &out, const SymbolTable &symbols) = 0;
 };
 
 class Type : public Base {
@@ -28,7 +31,9 @@ public:
   static Type I32() { return {TypeKind::I32}; }
   static Type Unit() { return {TypeKind::Unit}; }
 
-  void Dump(std::ostream &out) override;
+  TypeKind get_kind() const { return type; }
+
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
 
 private:
   TypeKind type;
@@ -55,13 +60,21 @@ enum class BinaryOp {
   Sar
 };
 
-std::string get_binary_op_repr(const BinaryOp &);
+std::string_view get_binary_op_repr(const BinaryOp &);
+// `a op b == b op a`
+bool is_commutative(BinaryOp op);
 
 class Value : public Base {
 public:
-  std::optional<std::string> name;
+  static constexpr std::uint32_t NO_ID = UINT32_MAX;
+
+  // Number of an instruction's result within its function, printed as
+  // `%<id>`. Assigned by `Function::number_values`.
+  std::uint32_t id = NO_ID;
+
   virtual ValueKind kind() const = 0;
-  virtual std::string get_reprs() = 0;
+  // Prints how an operand refers to this value
+  virtual void DumpRef(Emitter &out) = 0;
 };
 
 class Integer final : public Value {
@@ -70,9 +83,10 @@ private:
 
 public:
   Integer(std::int32_t val) : val_(val) {}
+  std::int32_t get_val() const { return val_; }
   ValueKind kind() const override { return ValueKind::Integer; }
-  void Dump(std::ostream &out) override;
-  std::string get_reprs() override;
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
+  void DumpRef(Emitter &out) override;
 };
 
 class Return final : public Value {
@@ -81,9 +95,11 @@ private:
 
 public:
   Return(Value *ret_val_) : return_val(ret_val_) {}
+  Value *get_return_val() const { return return_val; }
+  void set_return_val(Value *val) { return_val = val; }
   ValueKind kind() const override { return ValueKind::Return; }
-  void Dump(std::ostream &out) override;
-  std::string get_reprs() override;
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
+  void DumpRef(Emitter &out) override;
 };
 
 class Binary final : public Value {
@@ -95,9 +111,16 @@ private:
 public:
   Binary(BinaryOp op_, Value *lhs_, Value *rhs_)
       : lhs(lhs_), rhs(rhs_), op(op_) {}
+  BinaryOp get_op() const { return op; }
+  Value *get_lhs() const { return lhs; }
+  Value *get_rhs() const { return rhs; }
+  void set_operands(Value *lhs_, Value *rhs_) {
+    lhs = lhs_;
+    rhs = rhs_;
+  }
   ValueKind kind() const override { return ValueKind::Binary; }
-  void Dump(std::ostream &out) override;
-  std::string get_reprs() override;
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
+  void DumpRef(Emitter &out) override;
 };
 
 class BasicBlock : public Base {
@@ -105,8 +128,8 @@ public:
   std::vector<std::unique_ptr<Value>> pool;
   std::vector<Value *> insts;
 
-  BasicBlock(std::string name_) : name(name_) {}
-  BasicBlock() : name("") {}
+  BasicBlock(Symbol name_) : name(name_) {}
+  BasicBlock() = default;
 
   // allocates in pool, optionally also appends to insts
   template <class T, class... Args> T *Make(bool is_inst, Args &&...args) {
@@ -117,26 +140,38 @@ public:
     return p;
   }
 
-  void Dump(std::ostream &out) override;
+  // Invalid for an unnamed block
+  Symbol get_name() const { return name; }
+
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
 
 private:
-  std::string name;
+  Symbol name;
 };
 
 class Function : public Base {
 public:
-  std::string name;
+  Symbol name;
   std::unique_ptr<Type> type;
   std::vector<std::unique_ptr<BasicBlock>> basicblocks;
 
-  void Dump(std::ostream &out) override;
+  // Numbers the results of the instructions `%0`, `%1`, ... in block and
+  // instruction order. Only depends on the function itself, so the names are
+  // the same on every run and for every dump.
+  void number_values();
+
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
 };
 
 class Program : public Base {
 public:
+  // Names of functions and blocks of this unit
+  SymbolTable symbols;
   std::vector<std::unique_ptr<Value>> global_values;
   std::vector<std::unique_ptr<Function>> functions;
 
-  void Dump(std::ostream &out) override;
+  void Dump(Emitter &out) { Dump(out, symbols); }
+  void Dump(Emitter &out, const SymbolTable &symbols) override;
 };
+
 } // namespace koopa_ast
@@ -0,0 +1,143 @@
+#include "liveness.hpp"
+#include <algorithm>
+
+bool needs_register(koopa_raw_value_t value) {
+  switch (value->kind.tag) {
+  case KOOPA_RVT_INTEGER:
+  case KOOPA_RVT_ZERO_INIT:
+  case KOOPA_RVT_UNDEF:
+  case KOOPA_RVT_AGGREGATE:
+  case KOOPA_RVT_GLOBAL_ALLOC:
+  case KOOPA_RVT_ALLOC:
+    return false;
+  default:
+    return value->ty->tag != KOOPA_RTT_UNIT;
+  }
+}
+
+using ValueSet = std::unordered_set<koopa_raw_value_t>;
+
+LivenessInfo LivenessInfo::compute(koopa_raw_function_t func) {
+  LivenessInfo info;
+
+  std::vector<koopa_raw_basic_block_t> blocks;
+  for (uint32_t i = 0; i < func->bbs.len; i++) {
+    blocks.push_back(
+        reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+  }
+
+  // Number the instructions and collect local use/def sets
+  std::unordered_map<koopa_raw_basic_block_t, ValueSet> uses, defs;
+  std::unordered_map<koopa_raw_value_t, LiveInterval> ranges;
+  uint32_t pos = 0;
+
+  for (auto bb : blocks) {
+    uint32_t first = pos;
+    auto &use = uses[bb];
+    auto &def = defs[bb];
+
+    for (uint32_t i = 0; i < bb->insts.len; i++, pos++) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+      info.position[inst] = pos;
+
+      for_each_operand(inst, [&](koopa_raw_value_t operand) {
+        if (!needs_register(operand))
+          return;
+        if (!def.count(operand))
+          use.insert(operand);
+        auto &range = ranges[operand];
+        range.end = std::max(range.end, pos);
+        range.use_weight += 1;
+      });
+
+      if (inst->kind.tag == KOOPA_RVT_CALL)
+        info.calls.push_back(pos);
+
+      if (needs_register(inst)) {
+        def.insert(inst);
+        auto &range = ranges[inst];
+        range.value = inst;
+        range.start = std::min(range.start, pos);
+        range.end = std::max(range.end, pos);
+      }
+
+      switch (inst->kind.tag) {
+      case KOOPA_RVT_BRANCH:
+        info.successors[bb].push_back(inst->kind.data.branch.true_bb);
+        info.successors[bb].push_back(inst->kind.data.branch.false_bb);
+        break;
+      case KOOPA_RVT_JUMP:
+        info.successors[bb].push_back(inst->kind.data.jump.target);
+        break;
+      default:
+        break;
+      }
+    }
+
+    // Empty blocks get an empty range ending just before the next block
+    info.block_range[bb] = {first, pos == first ? first : pos - 1};
+  }
+
+  // Backward dataflow: live_in = use | (live_out - def)
+  std::unordered_map<koopa_raw_basic_block_t, ValueSet> live_in;
+  auto &live_out = info.live_out;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+      auto bb = *it;
+      ValueSet out;
+      for (auto succ : info.successors[bb]) {
+        auto &succ_in = live_in[succ];
+        out.insert(succ_in.begin(), succ_in.end());
+      }
+
+      ValueSet in = uses[bb];
+      for (auto v : out) {
+        if (!defs[bb].count(v))
+          in.insert(v);
+      }
+
+      if (in != live_in[bb] || out != live_out[bb]) {
+        live_in[bb] = std::move(in);
+        live_out[bb] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+
+  // Stretch the ranges over every block the value is live through
+  for (auto bb : blocks) {
+    auto [first, last] = info.block_range[bb];
+    for (auto v : live_in[bb]) {
+      auto &range = ranges[v];
+      range.start = std::min(range.start, first);
+    }
+    for (auto v : live_out[bb]) {
+      auto &range = ranges[v];
+      range.end = std::max(range.end, last);
+      if (!defs[bb].count(v))
+        range.start = std::min(range.start, first);
+    }
+  }
+
+  for (auto &[value, range] : ranges) {
+    // Operands that are never defined in this function (e.g. arguments) have
+    // no owner, skip them
+    if (!range.value)
+      continue;
+    auto call = std::upper_bound(info.calls.begin(), info.calls.end(),
+                                 range.start);
+    range.crosses_call = call != info.calls.end() && *call < range.end;
+    info.intervals.push_back(range);
+  }
+
+  std::sort(info.intervals.begin(), info.intervals.end(),
+            [](const LiveInterval &a, const LiveInterval &b) {
+              if (a.start != b.start)
+                return a.start < b.start;
+              return a.end < b.end;
+            });
+
+  return info;
+}
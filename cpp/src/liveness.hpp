@@ -0,0 +1,89 @@
+#pragma once
+
+#include "koopa.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Live range of one register-carrying value, in instruction positions of the
+// function's linear order (blocks in slice order, instructions in block
+// order). A value is live from its definition up to and including its last
+// use; there are no holes, a range is just [start, end].
+struct LiveInterval {
+  koopa_raw_value_t value = nullptr;
+  std::uint32_t start = UINT32_MAX;
+  std::uint32_t end = 0;
+  // Some call lies strictly inside the interval, so the value cannot stay in
+  // a caller-saved register
+  bool crosses_call = false;
+  // Number of uses, used to pick what to spill
+  double use_weight = 0;
+};
+
+class LivenessInfo {
+public:
+  // Linear position of every instruction
+  std::unordered_map<koopa_raw_value_t, std::uint32_t> position;
+  // One interval per value that needs a register, sorted by start
+  std::vector<LiveInterval> intervals;
+  // Positions of call instructions, ascending
+  std::vector<std::uint32_t> calls;
+  // First and last instruction position of each block
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::pair<std::uint32_t, std::uint32_t>>
+      block_range;
+  // Successors of each block, from its terminator
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::vector<koopa_raw_basic_block_t>>
+      successors;
+  // Values live on exit from each block
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::unordered_set<koopa_raw_value_t>>
+      live_out;
+
+  static LivenessInfo compute(koopa_raw_function_t func);
+};
+
+// Whether the value is computed by an instruction and held in a register
+// (as opposed to constants, globals and instructions without a result)
+bool needs_register(koopa_raw_value_t value);
+
+// Calls `f(operand)` for every value operand of the instruction
+template <class F> void for_each_operand(koopa_raw_value_t inst, F &&f) {
+  const auto &kind = inst->kind;
+  switch (kind.tag) {
+  case KOOPA_RVT_BINARY:
+    f(kind.data.binary.lhs);
+    f(kind.data.binary.rhs);
+    break;
+  case KOOPA_RVT_RETURN:
+    if (kind.data.ret.value)
+      f(kind.data.ret.value);
+    break;
+  case KOOPA_RVT_BRANCH:
+    f(kind.data.branch.cond);
+    break;
+  case KOOPA_RVT_LOAD:
+    f(kind.data.load.src);
+    break;
+  case KOOPA_RVT_STORE:
+    f(kind.data.store.value);
+    f(kind.data.store.dest);
+    break;
+  case KOOPA_RVT_GET_PTR:
+    f(kind.data.get_ptr.src);
+    f(kind.data.get_ptr.index);
+    break;
+  case KOOPA_RVT_GET_ELEM_PTR:
+    f(kind.data.get_elem_ptr.src);
+    f(kind.data.get_elem_ptr.index);
+    break;
+  case KOOPA_RVT_CALL:
+    for (uint32_t i = 0; i < kind.data.call.args.len; i++)
+      f(reinterpret_cast<koopa_raw_value_t>(kind.data.call.args.buffer[i]));
+    break;
+  default:
+    break;
+  }
+}
@@ -0,0 +1,175 @@
+#include "mir.hpp"
+
+static constexpr const std::string_view INDENT = "\t";
+
+const MOpInfo MOP_INFO[] = {
+    {"add", MFormat::R},        {"sub", MFormat::R},
+    {"mul", MFormat::R},        {"mulh", MFormat::R},
+    {"div", MFormat::R},        {"rem", MFormat::R},
+    {"and", MFormat::R},        {"or", MFormat::R},
+    {"xor", MFormat::R},        {"sll", MFormat::R},
+    {"srl", MFormat::R},        {"sra", MFormat::R},
+    {"slt", MFormat::R},        {"addi", MFormat::I},
+    {"andi", MFormat::I},       {"ori", MFormat::I},
+    {"xori", MFormat::I},       {"slli", MFormat::I},
+    {"srli", MFormat::I},       {"srai", MFormat::I},
+    {"slti", MFormat::I},       {"mv", MFormat::Unary},
+    {"neg", MFormat::Unary},    {"not", MFormat::Unary},
+    {"seqz", MFormat::Unary},   {"snez", MFormat::Unary},
+    {"li", MFormat::Imm},       {"lui", MFormat::Imm},
+    {"lw", MFormat::Load},      {"sw", MFormat::Store},
+    {"beq", MFormat::Branch},   {"bne", MFormat::Branch},
+    {"blt", MFormat::Branch},   {"bge", MFormat::Branch},
+    {"beqz", MFormat::BranchZ}, {"bnez", MFormat::BranchZ},
+    {"j", MFormat::Jump},       {"ret", MFormat::None},
+};
+static_assert(sizeof(MOP_INFO) / sizeof(MOP_INFO[0]) ==
+                  static_cast<std::size_t>(MOp::RET) + 1,
+              "MOP_INFO must have an entry for every MOp");
+
+MReg MReg::from(reg_t reg) {
+  switch (reg.series) {
+  case 't':
+    // t0-t2 are x5-x7, t3-t6 are x28-x31
+    return phys(reg.idx < 3 ? 5 + reg.idx : 25 + reg.idx);
+  case 's':
+    // s0-s1 are x8-x9, s2-s11 are x18-x27
+    return phys(reg.idx < 2 ? 8 + reg.idx : 16 + reg.idx);
+  case 'a':
+    return phys(10 + reg.idx);
+  default:
+    return phys(reg.idx);
+  }
+}
+
+// Names of the physical registers as they appear in the output, the same
+// the allocator's `reg_t` prints
+static constexpr const std::string_view REGISTER_NAMES[] = {
+    "x0", "x1", "sp", "x3", "x4",  "t0",  "t1", "t2", "s0", "s1", "a0",
+    "a1", "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+    "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+static Emitter &operator<<(Emitter &out, MReg reg) {
+  if (reg.is_virtual()) {
+    return out << 'v' << reg.index();
+  }
+  return out << REGISTER_NAMES[reg.index()];
+}
+
+// Block 0 starts at the function's symbol, the others at local labels
+static void print_label(Emitter &out, const MFunction &func,
+                        std::int32_t block) {
+  if (block == 0) {
+    out << func.name;
+    return;
+  }
+  out << ".L" << func.name << '_' << block;
+}
+
+bool MInst::writes_rd() const {
+  switch (info(op).format) {
+  case MFormat::R:
+  case MFormat::I:
+  case MFormat::Unary:
+  case MFormat::Imm:
+  case MFormat::Load:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool MInst::reads(MReg reg) const {
+  switch (info(op).format) {
+  case MFormat::R:
+  case MFormat::Store:
+  case MFormat::Branch:
+    return rs1 == reg || rs2 == reg;
+  case MFormat::I:
+  case MFormat::Unary:
+  case MFormat::Load:
+  case MFormat::BranchZ:
+    return rs1 == reg;
+  default:
+    return false;
+  }
+}
+
+bool MInst::is_terminator() const {
+  switch (info(op).format) {
+  case MFormat::Branch:
+  case MFormat::BranchZ:
+  case MFormat::Jump:
+  case MFormat::None:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void MFunction::print(Emitter &out) const {
+  out << name << ":\n";
+  for (std::size_t b = 0; b < blocks.size(); b++) {
+    if (b > 0) {
+      print_label(out, *this, static_cast<std::int32_t>(b));
+      out << ":\n";
+    }
+    for (auto i = blocks[b].begin; i < blocks[b].end; i++) {
+      print(out, insts[i]);
+    }
+  }
+}
+
+void MFunction::print(Emitter &out, const MInst &inst) const {
+  std::string_view mnemonic = info(inst.op).mnemonic;
+  out << INDENT << mnemonic;
+  if (info(inst.op).format == MFormat::None) {
+    out << '\n';
+    return;
+  }
+  // Operands start in the same column for every mnemonic
+  out << std::string_view("      ", 6 - mnemonic.size());
+  switch (info(inst.op).format) {
+  case MFormat::R:
+    out << inst.rd << ", " << inst.rs1 << ", " << inst.rs2;
+    break;
+  case MFormat::I:
+    out << inst.rd << ", " << inst.rs1 << ", " << inst.imm;
+    break;
+  case MFormat::Unary:
+    out << inst.rd << ", " << inst.rs1;
+    break;
+  case MFormat::Imm:
+    out << inst.rd << ", " << inst.imm;
+    break;
+  case MFormat::Load:
+    out << inst.rd << ", " << inst.imm << '(' << inst.rs1 << ')';
+    break;
+  case MFormat::Store:
+    out << inst.rs2 << ", " << inst.imm << '(' << inst.rs1 << ')';
+    break;
+  case MFormat::Branch:
+    out << inst.rs1 << ", " << inst.rs2 << ", ";
+    print_label(out, *this, inst.imm);
+    break;
+  case MFormat::BranchZ:
+    out << inst.rs1 << ", ";
+    print_label(out, *this, inst.imm);
+    break;
+  case MFormat::Jump:
+    print_label(out, *this, inst.imm);
+    break;
+  case MFormat::None:
+    break;
+  }
+  out << '\n';
+}
+
+void MProgram::print(Emitter &out) const {
+  // Mark the start of programs
+  out << INDENT << ".text\n"
+      << INDENT << ".global main\n";
+  for (auto const &func : functions) {
+    func.print(out);
+  }
+}
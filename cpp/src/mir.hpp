@@ -0,0 +1,184 @@
+#pragma once
+
+#include "emitter.hpp"
+#include "register.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Machine IR of the RISC-V backend. `CodeGenUnit` lowers each function into
+// it, backend passes such as the peephole optimiser rewrite it, and printing
+// it as assembly is the last stage. Instructions are small fixed-size
+// records kept in one flat array per function; basic blocks are ranges of
+// that array, so passes walk contiguous memory.
+
+// Opcodes, pseudo-instructions included. The order matches `MOP_INFO`.
+enum class MOp : std::uint8_t {
+  // rd, rs1, rs2
+  ADD,
+  SUB,
+  MUL,
+  MULH,
+  DIV,
+  REM,
+  AND,
+  OR,
+  XOR,
+  SLL,
+  SRL,
+  SRA,
+  SLT,
+  // rd, rs1, imm
+  ADDI,
+  ANDI,
+  ORI,
+  XORI,
+  SLLI,
+  SRLI,
+  SRAI,
+  SLTI,
+  // rd, rs1
+  MV,
+  NEG,
+  NOT,
+  SEQZ,
+  SNEZ,
+  // rd, imm
+  LI,
+  LUI,
+  // rd, imm(rs1) and rs2, imm(rs1)
+  LW,
+  SW,
+  // rs1, rs2, block / rs1, block
+  BEQ,
+  BNE,
+  BLT,
+  BGE,
+  BEQZ,
+  BNEZ,
+  // block
+  J,
+  RET,
+};
+
+// Operand layout of an opcode, which decides how it is printed and which
+// registers it reads and writes
+enum class MFormat : std::uint8_t {
+  R,       // op rd, rs1, rs2
+  I,       // op rd, rs1, imm
+  Unary,   // op rd, rs1
+  Imm,     // op rd, imm
+  Load,    // op rd, imm(rs1)
+  Store,   // op rs2, imm(rs1)
+  Branch,  // op rs1, rs2, block
+  BranchZ, // op rs1, block
+  Jump,    // op block
+  None,    // op
+};
+
+struct MOpInfo {
+  std::string_view mnemonic;
+  MFormat format;
+};
+
+extern const MOpInfo MOP_INFO[];
+
+inline const MOpInfo &info(MOp op) {
+  return MOP_INFO[static_cast<std::size_t>(op)];
+}
+
+// Register operand: physical register `x0`-`x31`, or a virtual register
+// numbered per function for passes that run before registers are assigned
+struct MReg {
+  std::uint16_t id = 0;
+
+  static constexpr std::uint16_t VIRTUAL_BASE = 32;
+
+  static constexpr MReg phys(unsigned x) {
+    return MReg{static_cast<std::uint16_t>(x)};
+  }
+  static constexpr MReg virt(unsigned n) {
+    return MReg{static_cast<std::uint16_t>(VIRTUAL_BASE + n)};
+  }
+  // The register the allocator calls `reg`
+  static MReg from(reg_t reg);
+
+  bool is_virtual() const { return id >= VIRTUAL_BASE; }
+  // Number of the physical or the virtual register
+  unsigned index() const { return is_virtual() ? id - VIRTUAL_BASE : id; }
+
+  bool operator==(MReg other) const { return id == other.id; }
+  bool operator!=(MReg other) const { return id != other.id; }
+};
+
+static constexpr const MReg MREG_ZERO = MReg::phys(0);
+static constexpr const MReg MREG_RA = MReg::phys(1);
+static constexpr const MReg MREG_SP = MReg::phys(2);
+static constexpr const MReg MREG_A0 = MReg::phys(10);
+
+// Whether `value` fits the signed 12-bit immediate of I- and S-type
+// instructions
+inline bool fits_imm12(std::int64_t value) {
+  return value >= -2048 && value <= 2047;
+}
+
+// A 32-bit constant as `lui hi` + `addi lo`, which is how `li` is expanded
+// beyond 12 bits (without the `addi` if `lo` is 0)
+struct ImmSplit {
+  std::int32_t hi;
+  std::int32_t lo;
+};
+
+inline ImmSplit split_imm32(std::int32_t value) {
+  // `addi` sign-extends its immediate, so the upper part is rounded to make
+  // up for a negative lower one
+  std::int32_t lo =
+      static_cast<std::int32_t>(static_cast<std::uint32_t>(value) << 20) >> 20;
+  std::uint32_t hi =
+      (static_cast<std::uint32_t>(value) - static_cast<std::uint32_t>(lo)) >>
+      12;
+  return {static_cast<std::int32_t>(hi), lo};
+}
+
+// Operands an opcode does not use stay `x0`/0
+struct MInst {
+  MOp op;
+  MReg rd;
+  MReg rs1;
+  MReg rs2;
+  // Immediate, memory offset, or index of the target block for branches
+  std::int32_t imm = 0;
+
+  bool writes_rd() const;
+  bool reads(MReg reg) const;
+  // Branches, jumps and returns end a block
+  bool is_terminator() const;
+};
+static_assert(sizeof(MInst) == 12, "MInst should stay a compact record");
+
+// Instructions `[begin, end)` of the function
+struct MBlock {
+  std::uint32_t begin;
+  std::uint32_t end;
+};
+
+struct MFunction {
+  std::string name;
+  std::vector<MInst> insts;
+  // In layout order. The first one is the entry and holds the prologue,
+  // the function body starts with the second.
+  std::vector<MBlock> blocks;
+
+  // Assembly of the function, labels included
+  void print(Emitter &out) const;
+
+private:
+  void print(Emitter &out, const MInst &inst) const;
+};
+
+struct MProgram {
+  std::vector<MFunction> functions;
+
+  void print(Emitter &out) const;
+};
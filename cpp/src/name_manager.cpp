@@ -1,6 +0,0 @@
-#include "name_manager.hpp"
-#include <string>
-
-std::string koopa_ast::VarNameManager::get_new_var_name() {
-  return "%" + std::to_string(this->var_count++);
-}
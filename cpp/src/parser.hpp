@@ -0,0 +1,13 @@
+#pragma once
+
+#include "arena.hpp"
+#include "c_ast.hpp"
+#include "source_file.hpp"
+#include <string>
+
+// Parses one translation unit in place from `source` with its own scanner,
+// allocating the AST from `arena`. Identifiers in the AST point into
+// `source`. Returns nullptr on a syntax error, which is described in
+// `error`. Safe to call concurrently for different units.
+c_ast::BaseAST *parse_unit(SourceFile &source, Arena &arena,
+                           std::string &error);
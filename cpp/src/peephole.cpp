@@ -0,0 +1,377 @@
+#include "peephole.hpp"
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Instructions of the block being optimised
+using MInsts = std::vector<MInst>;
+
+// Registers whose values the caller sees after `ret`: the result, the stack
+// pointer, the return address and the callee-saved registers (`s0`-`s1`,
+// `s2`-`s11`)
+static bool live_at_return(MReg reg) {
+  unsigned x = reg.index();
+  return !reg.is_virtual() &&
+         (reg == MREG_A0 || reg == MREG_RA || reg == MREG_SP ||
+          x == 8 || x == 9 || (x >= 18 && x <= 27));
+}
+
+// Lowering never carries the scratch registers `t5`/`t6` from one block to
+// another, so they are dead wherever control leaves the block
+static bool is_block_local(MReg reg) {
+  return reg == MReg::phys(30) || reg == MReg::phys(31);
+}
+
+// Whether the value `reg` holds before `insts[from]` is never read. Other
+// blocks count as reading everything but the scratch registers.
+static bool dead_from(const MInsts &insts, std::size_t from, MReg reg) {
+  for (std::size_t i = from; i < insts.size(); i++) {
+    const MInst &inst = insts[i];
+    if (inst.reads(reg)) {
+      return false;
+    }
+    if (inst.op == MOp::RET) {
+      return !live_at_return(reg);
+    }
+    if (inst.is_terminator()) {
+      return is_block_local(reg);
+    }
+    if (inst.writes_rd() && inst.rd == reg) {
+      return true;
+    }
+  }
+  return is_block_local(reg);
+}
+
+// Whether `insts[i]` is the last reader of the value `reg` holds before it
+static bool last_use(const MInsts &insts, std::size_t i, MReg reg) {
+  const MInst &inst = insts[i];
+  if (inst.writes_rd() && inst.rd == reg) {
+    return true;
+  }
+  if (inst.is_terminator()) {
+    return inst.op != MOp::RET ? is_block_local(reg) : !live_at_return(reg);
+  }
+  return dead_from(insts, i + 1, reg);
+}
+
+static void replace_reads(MInst &inst, MReg from, MReg to) {
+  switch (info(inst.op).format) {
+  case MFormat::R:
+  case MFormat::Store:
+  case MFormat::Branch:
+    if (inst.rs2 == from) {
+      inst.rs2 = to;
+    }
+    [[fallthrough]];
+  default:
+    if (inst.rs1 == from) {
+      inst.rs1 = to;
+    }
+  }
+}
+
+// `op rd, rs, 0` and `op rd, rs, x0` that leave `rs` as it is -> `mv rd, rs`
+static bool identity_to_move(MInsts &insts, std::size_t i) {
+  MInst &inst = insts[i];
+  MReg src;
+  switch (inst.op) {
+  case MOp::ADDI:
+  case MOp::ORI:
+  case MOp::XORI:
+  case MOp::SLLI:
+  case MOp::SRLI:
+  case MOp::SRAI:
+    if (inst.imm != 0) {
+      return false;
+    }
+    src = inst.rs1;
+    break;
+  case MOp::ANDI:
+    if (inst.imm != -1) {
+      return false;
+    }
+    src = inst.rs1;
+    break;
+  case MOp::ADD:
+  case MOp::OR:
+  case MOp::XOR:
+    if (inst.rs1 == MREG_ZERO) {
+      src = inst.rs2;
+      break;
+    }
+    [[fallthrough]];
+  case MOp::SUB:
+  case MOp::SLL:
+  case MOp::SRL:
+  case MOp::SRA:
+    if (inst.rs2 != MREG_ZERO) {
+      return false;
+    }
+    src = inst.rs1;
+    break;
+  default:
+    return false;
+  }
+  inst = MInst{MOp::MV, inst.rd, src};
+  return true;
+}
+
+// `mv r, r`
+static bool self_move(MInsts &insts, std::size_t i) {
+  if (insts[i].op != MOp::MV || insts[i].rd != insts[i].rs1) {
+    return false;
+  }
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// Results that do not depend on the register: `xor rd, r, r`, `sub rd, r, r`,
+// `slt rd, r, r`, `seqz rd, x0`, `snez rd, x0`
+static bool self_xor(MInsts &insts, std::size_t i) {
+  MInst &inst = insts[i];
+  std::int32_t value;
+  switch (inst.op) {
+  case MOp::XOR:
+  case MOp::SUB:
+  case MOp::SLT:
+    if (inst.rs1 != inst.rs2) {
+      return false;
+    }
+    value = 0;
+    break;
+  case MOp::SEQZ:
+  case MOp::SNEZ:
+    if (inst.rs1 != MREG_ZERO) {
+      return false;
+    }
+    value = inst.op == MOp::SEQZ;
+    break;
+  default:
+    return false;
+  }
+  inst = MInst{MOp::LI, inst.rd, MREG_ZERO, MREG_ZERO, value};
+  return true;
+}
+
+// `mv t, r; op ..., t, ...` where `t` dies -> `op ..., r, ...`. `li t, 0`
+// is a move from `x0`.
+static bool forward_copy(MInsts &insts, std::size_t i) {
+  const MInst &copy = insts[i];
+  MReg src;
+  if (copy.op == MOp::MV) {
+    src = copy.rs1;
+  } else if (copy.op == MOp::LI && copy.imm == 0) {
+    src = MREG_ZERO;
+  } else {
+    return false;
+  }
+  MReg tmp = copy.rd;
+  if (i + 1 >= insts.size() || !insts[i + 1].reads(tmp) ||
+      !last_use(insts, i + 1, tmp)) {
+    return false;
+  }
+  replace_reads(insts[i + 1], tmp, src);
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// `op t, ...; mv r, t` where `t` dies -> `op r, ...`
+static bool backward_copy(MInsts &insts, std::size_t i) {
+  if (i + 1 >= insts.size()) {
+    return false;
+  }
+  MInst &def = insts[i];
+  const MInst &copy = insts[i + 1];
+  if (!def.writes_rd() || copy.op != MOp::MV || copy.rs1 != def.rd ||
+      def.rd == MREG_ZERO || !dead_from(insts, i + 2, def.rd)) {
+    return false;
+  }
+  def.rd = copy.rd;
+  insts.erase(insts.begin() + i + 1);
+  return true;
+}
+
+// A set-on-condition whose result only decides the next branch
+struct BranchFusion {
+  MOp compare;
+  MOp branch;
+  MOp fused;
+};
+
+static constexpr const BranchFusion BRANCH_FUSIONS[] = {
+    {MOp::SLT, MOp::BNEZ, MOp::BLT},   {MOp::SLT, MOp::BEQZ, MOp::BGE},
+    {MOp::XOR, MOp::BNEZ, MOp::BNE},   {MOp::XOR, MOp::BEQZ, MOp::BEQ},
+    {MOp::SUB, MOp::BNEZ, MOp::BNE},   {MOp::SUB, MOp::BEQZ, MOp::BEQ},
+    {MOp::SEQZ, MOp::BNEZ, MOp::BEQZ}, {MOp::SEQZ, MOp::BEQZ, MOp::BNEZ},
+    {MOp::SNEZ, MOp::BNEZ, MOp::BNEZ}, {MOp::SNEZ, MOp::BEQZ, MOp::BEQZ},
+};
+
+// `slt t, a, b; bnez t, L` -> `blt a, b, L` and the like
+static bool fuse_compare_branch(MInsts &insts, std::size_t i) {
+  if (i + 1 >= insts.size()) {
+    return false;
+  }
+  const MInst &cmp = insts[i];
+  const MInst &branch = insts[i + 1];
+  if (info(branch.op).format != MFormat::BranchZ || branch.rs1 != cmp.rd ||
+      !is_block_local(cmp.rd) || !dead_from(insts, i + 2, cmp.rd)) {
+    return false;
+  }
+  for (auto const &fusion : BRANCH_FUSIONS) {
+    if (fusion.compare == cmp.op && fusion.branch == branch.op) {
+      insts[i] = MInst{fusion.fused, MREG_ZERO, cmp.rs1, cmp.rs2,
+                       branch.imm};
+      insts.erase(insts.begin() + i + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Each rule looks at the instructions from `i` on and rewrites them if they
+// match. Every rewrite makes the block shorter or turns an instruction
+// into a simpler one, so applying them until nothing matches terminates
+using PeepholeRule = bool (*)(MInsts &insts, std::size_t i);
+
+static constexpr const PeepholeRule RULES[] = {
+    identity_to_move, self_move,     self_xor,
+    forward_copy,     backward_copy, fuse_compare_branch,
+};
+
+static bool apply_rules(MInsts &insts) {
+  bool changed = false;
+  for (std::size_t i = 0; i < insts.size();) {
+    bool matched = false;
+    for (auto rule : RULES) {
+      if (rule(insts, i)) {
+        matched = true;
+        break;
+      }
+    }
+    if (matched) {
+      changed = true;
+      // The rewrite may let a rule match one instruction earlier
+      i = i > 0 ? i - 1 : 0;
+    } else {
+      i++;
+    }
+  }
+  return changed;
+}
+
+// Value `insts[i]` sets its destination to, with the number of instructions
+// involved: `li`, `lui`, or `lui` followed by `addi` of the same register
+static std::optional<std::pair<std::int32_t, std::size_t>>
+materialised_constant(const MInsts &insts, std::size_t i) {
+  const MInst &inst = insts[i];
+  if (inst.op == MOp::LI) {
+    return std::make_pair(inst.imm, std::size_t(1));
+  }
+  if (inst.op != MOp::LUI) {
+    return std::nullopt;
+  }
+  std::uint32_t value = static_cast<std::uint32_t>(inst.imm) << 12;
+  if (i + 1 < insts.size()) {
+    const MInst &next = insts[i + 1];
+    if (next.op == MOp::ADDI && next.rd == inst.rd && next.rs1 == inst.rd) {
+      value += static_cast<std::uint32_t>(next.imm);
+      return std::make_pair(static_cast<std::int32_t>(value), std::size_t(2));
+    }
+  }
+  return std::make_pair(static_cast<std::int32_t>(value), std::size_t(1));
+}
+
+// Drops `li` of constants the register already holds, and turns `lui` +
+// `addi` into a move when another register holds the constant
+static bool forward_constants(MInsts &insts) {
+  bool changed = false;
+  // Few registers hold known constants at a time, a flat list will do
+  std::vector<std::pair<MReg, std::int32_t>> known;
+  auto find = [&](MReg reg) {
+    for (auto it = known.begin(); it != known.end(); ++it) {
+      if (it->first == reg) {
+        return it;
+      }
+    }
+    return known.end();
+  };
+  auto forget = [&](MReg reg) {
+    auto it = find(reg);
+    if (it != known.end()) {
+      known.erase(it);
+    }
+  };
+
+  for (std::size_t i = 0; i < insts.size();) {
+    const MInst &inst = insts[i];
+    if (auto constant = materialised_constant(insts, i)) {
+      auto [value, length] = *constant;
+      MReg rd = inst.rd;
+      auto it = find(rd);
+      if (it != known.end() && it->second == value) {
+        insts.erase(insts.begin() + i, insts.begin() + i + length);
+        changed = true;
+        continue;
+      }
+      if (length == 2) {
+        for (auto const &[reg, held] : known) {
+          if (held == value) {
+            insts[i] = MInst{MOp::MV, rd, reg};
+            insts.erase(insts.begin() + i + 1);
+            length = 1;
+            changed = true;
+            break;
+          }
+        }
+      }
+      forget(rd);
+      known.emplace_back(rd, value);
+      i += length;
+      continue;
+    }
+
+    if (inst.is_terminator()) {
+      known.clear();
+    } else if (inst.writes_rd()) {
+      std::optional<std::int32_t> copied;
+      if (inst.op == MOp::MV) {
+        auto src = find(inst.rs1);
+        if (src != known.end()) {
+          copied = src->second;
+        }
+      }
+      forget(inst.rd);
+      if (copied) {
+        known.emplace_back(inst.rd, *copied);
+      }
+    }
+    i++;
+  }
+  return changed;
+}
+
+static void optimise_block(MInsts &insts) {
+  apply_rules(insts);
+  while (forward_constants(insts) && apply_rules(insts)) {
+  }
+}
+
+std::size_t run_peephole(MFunction &func) {
+  MInsts insts;
+  insts.reserve(func.insts.size());
+  MInsts block;
+  for (auto &range : func.blocks) {
+    block.assign(func.insts.begin() + range.begin,
+                 func.insts.begin() + range.end);
+    optimise_block(block);
+    range.begin = static_cast<std::uint32_t>(insts.size());
+    insts.insert(insts.end(), block.begin(), block.end());
+    range.end = static_cast<std::uint32_t>(insts.size());
+  }
+
+  std::size_t removed = func.insts.size() - insts.size();
+  func.insts = std::move(insts);
+  return removed;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mir.hpp"
+#include <cstddef>
+
+// Peephole optimisation of one function's machine instructions, one block at
+// a time, after register allocation and before printing. The local rewrites
+// come from a table of rules, tried at every instruction until none matches:
+//   - identities (`addi rd, rs, 0`, `xor rd, rs, x0`, ...) become moves,
+//     and moves of a register to itself are dropped
+//   - self-xors and comparisons of a register with itself become constants
+//   - a move into a register that is only read once is folded into the
+//     reader, and a result only moved elsewhere is computed there directly
+//   - a comparison only tested by the next branch is fused into it
+// Then constants are followed through the block, dropping `li` of
+// a value the register already holds. Returns how many instructions were
+// removed.
+std::size_t run_peephole(MFunction &func);
@@ -0,0 +1,206 @@
+#include "raw_builder.hpp"
+#include "logger.hpp"
+
+static const koopa_raw_type_kind_t I32_TYPE = {KOOPA_RTT_INT32, {}};
+static const koopa_raw_type_kind_t UNIT_TYPE = {KOOPA_RTT_UNIT, {}};
+
+static koopa_raw_binary_op_t lower_binary_op(koopa_ast::BinaryOp op) {
+  switch (op) {
+  case koopa_ast::BinaryOp::NotEq:
+    return KOOPA_RBO_NOT_EQ;
+  case koopa_ast::BinaryOp::Eq:
+    return KOOPA_RBO_EQ;
+  case koopa_ast::BinaryOp::Gt:
+    return KOOPA_RBO_GT;
+  case koopa_ast::BinaryOp::Lt:
+    return KOOPA_RBO_LT;
+  case koopa_ast::BinaryOp::Ge:
+    return KOOPA_RBO_GE;
+  case koopa_ast::BinaryOp::Le:
+    return KOOPA_RBO_LE;
+  case koopa_ast::BinaryOp::Add:
+    return KOOPA_RBO_ADD;
+  case koopa_ast::BinaryOp::Sub:
+    return KOOPA_RBO_SUB;
+  case koopa_ast::BinaryOp::Mul:
+    return KOOPA_RBO_MUL;
+  case koopa_ast::BinaryOp::Div:
+    return KOOPA_RBO_DIV;
+  case koopa_ast::BinaryOp::Mod:
+    return KOOPA_RBO_MOD;
+  case koopa_ast::BinaryOp::And:
+    return KOOPA_RBO_AND;
+  case koopa_ast::BinaryOp::Or:
+    return KOOPA_RBO_OR;
+  case koopa_ast::BinaryOp::Xor:
+    return KOOPA_RBO_XOR;
+  case koopa_ast::BinaryOp::Shl:
+    return KOOPA_RBO_SHL;
+  case koopa_ast::BinaryOp::Shr:
+    return KOOPA_RBO_SHR;
+  case koopa_ast::BinaryOp::Sar:
+    return KOOPA_RBO_SAR;
+  }
+  LOG_ERROR("Unknown binary operator.");
+}
+
+template <class T>
+koopa_raw_slice_t
+RawProgramBuilder::make_slice(const std::vector<T> &items,
+                              koopa_raw_slice_item_kind_t kind) {
+  auto **buffer = arena.NewArray<const void *>(items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    buffer[i] = items[i];
+  }
+  return koopa_raw_slice_t{buffer, static_cast<uint32_t>(items.size()), kind};
+}
+
+koopa_raw_type_t RawProgramBuilder::lower_type(koopa_ast::TypeKind kind) {
+  switch (kind) {
+  case koopa_ast::TypeKind::I32:
+    return &I32_TYPE;
+  case koopa_ast::TypeKind::Unit:
+    return &UNIT_TYPE;
+  }
+  LOG_ERROR("Unknown type kind.");
+}
+
+void RawProgramBuilder::add_use(koopa_raw_value_t used,
+                                koopa_raw_value_t user) {
+  users[used].push_back(user);
+}
+
+koopa_raw_value_t RawProgramBuilder::lower_value(const koopa_ast::Value &value) {
+  // Operands are shared between users, so only lower each value once
+  auto it = values.find(&value);
+  if (it != values.end()) {
+    return it->second;
+  }
+  it = globals.find(&value);
+  if (it != globals.end()) {
+    return it->second;
+  }
+
+  auto *raw = arena.New<koopa_raw_value_data_t>();
+  raw->name = nullptr;
+  raw->used_by = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_VALUE};
+
+  // Operands are either constants or instructions that appear earlier in the
+  // block, so this recursion is at most one level deep.
+  switch (value.kind()) {
+  case koopa_ast::ValueKind::Integer: {
+    auto &integer = static_cast<const koopa_ast::Integer &>(value);
+    raw->ty = &I32_TYPE;
+    raw->kind.tag = KOOPA_RVT_INTEGER;
+    raw->kind.data.integer.value = integer.get_val();
+    break;
+  }
+  case koopa_ast::ValueKind::Binary: {
+    auto &binary = static_cast<const koopa_ast::Binary &>(value);
+    raw->ty = &I32_TYPE;
+    raw->kind.tag = KOOPA_RVT_BINARY;
+    raw->kind.data.binary.op = lower_binary_op(binary.get_op());
+    raw->kind.data.binary.lhs = lower_value(*binary.get_lhs());
+    raw->kind.data.binary.rhs = lower_value(*binary.get_rhs());
+    add_use(raw->kind.data.binary.lhs, raw);
+    add_use(raw->kind.data.binary.rhs, raw);
+    break;
+  }
+  case koopa_ast::ValueKind::Return: {
+    auto &ret = static_cast<const koopa_ast::Return &>(value);
+    raw->ty = &UNIT_TYPE;
+    raw->kind.tag = KOOPA_RVT_RETURN;
+    if (ret.get_return_val()) {
+      raw->kind.data.ret.value = lower_value(*ret.get_return_val());
+      add_use(raw->kind.data.ret.value, raw);
+    } else {
+      raw->kind.data.ret.value = nullptr;
+    }
+    break;
+  }
+  }
+
+  values[&value] = raw;
+  return raw;
+}
+
+koopa_raw_basic_block_t
+RawProgramBuilder::lower_basic_block(const koopa_ast::BasicBlock &block) {
+  auto *raw = arena.New<koopa_raw_basic_block_data_t>();
+  raw->name = block.get_name().valid()
+                  ? arena.CopyString(symbols->name(block.get_name()))
+                  : nullptr;
+  raw->params = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_VALUE};
+  raw->used_by = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_VALUE};
+
+  std::vector<koopa_raw_value_t> insts;
+  insts.reserve(block.insts.size());
+  for (auto const *inst : block.insts) {
+    if (inst)
+      insts.push_back(lower_value(*inst));
+  }
+  raw->insts = make_slice(insts, KOOPA_RSIK_VALUE);
+
+  return raw;
+}
+
+koopa_raw_function_t
+RawProgramBuilder::lower_function(const koopa_ast::Function &func) {
+  auto *ty = arena.New<koopa_raw_type_kind_t>();
+  ty->tag = KOOPA_RTT_FUNCTION;
+  ty->data.function.params = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_TYPE};
+  ty->data.function.ret = lower_type(func.type->get_kind());
+
+  auto *raw = arena.New<koopa_raw_function_data_t>();
+  raw->ty = ty;
+  raw->name = arena.CopyString(symbols->name(func.name));
+  raw->params = koopa_raw_slice_t{nullptr, 0, KOOPA_RSIK_VALUE};
+
+  std::vector<koopa_raw_basic_block_t> bbs;
+  bbs.reserve(func.basicblocks.size());
+  for (auto const &bb : func.basicblocks) {
+    if (bb)
+      bbs.push_back(lower_basic_block(*bb));
+  }
+  raw->bbs = make_slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+
+  return raw;
+}
+
+void RawProgramBuilder::fill_used_by() {
+  for (auto const &[used, user_list] : users) {
+    // `used` was allocated by us as mutable data, only the handle is const
+    auto *data = const_cast<koopa_raw_value_data_t *>(used);
+    data->used_by = make_slice(user_list, KOOPA_RSIK_VALUE);
+  }
+  users.clear();
+}
+
+koopa_raw_program_t
+RawProgramBuilder::build(const koopa_ast::Program &program) {
+  koopa_raw_program_t raw;
+  symbols = &program.symbols;
+
+  std::vector<koopa_raw_value_t> global_values;
+  for (auto const &gv : program.global_values) {
+    if (gv)
+      global_values.push_back(lower_value(*gv));
+  }
+  raw.values = make_slice(global_values, KOOPA_RSIK_VALUE);
+
+  // Globals stay visible to every function, instructions do not
+  globals.swap(values);
+
+  std::vector<koopa_raw_function_t> funcs;
+  for (auto const &f : program.functions) {
+    if (!f)
+      continue;
+    funcs.push_back(lower_function(*f));
+    values.clear();
+  }
+  raw.funcs = make_slice(funcs, KOOPA_RSIK_FUNCTION);
+
+  fill_used_by();
+
+  return raw;
+}
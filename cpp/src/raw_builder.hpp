@@ -0,0 +1,40 @@
+#pragma once
+
+#include "arena.hpp"
+#include "koopa.h"
+#include "koopa_ast.hpp"
+#include <unordered_map>
+#include <vector>
+
+// Lowers our own `koopa_ast` straight into the `koopa_raw_*` structures that
+// the backend consumes, without going through the textual Koopa IR and
+// libkoopa's parser. Every raw structure lives in the builder's arena, so the
+// builder must outlive any use of the program it returns.
+class RawProgramBuilder {
+private:
+  Arena arena;
+  // Names of the program being built
+  const SymbolTable *symbols = nullptr;
+
+  // Lowered values of the function currently being built
+  std::unordered_map<const koopa_ast::Value *, koopa_raw_value_data_t *>
+      values;
+  std::unordered_map<const koopa_ast::Value *, koopa_raw_value_data_t *>
+      globals;
+  // Users of each lowered value, turned into `used_by` slices at the end
+  std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> users;
+
+  koopa_raw_type_t lower_type(koopa_ast::TypeKind);
+  koopa_raw_value_t lower_value(const koopa_ast::Value &);
+  koopa_raw_basic_block_t lower_basic_block(const koopa_ast::BasicBlock &);
+  koopa_raw_function_t lower_function(const koopa_ast::Function &);
+
+  template <class T>
+  koopa_raw_slice_t make_slice(const std::vector<T> &,
+                               koopa_raw_slice_item_kind_t);
+  void add_use(koopa_raw_value_t used, koopa_raw_value_t user);
+  void fill_used_by();
+
+public:
+  koopa_raw_program_t build(const koopa_ast::Program &);
+};
@@ -0,0 +1,145 @@
+#include "regalloc.hpp"
+#include <algorithm>
+#include <list>
+
+const std::vector<reg_t> CALLER_SAVED_REGISTERS = {
+    {'t', 0}, {'t', 1}, {'t', 2}, {'t', 3}, {'t', 4}, {'a', 0}, {'a', 1},
+    {'a', 2}, {'a', 3}, {'a', 4}, {'a', 5}, {'a', 6}, {'a', 7},
+};
+
+const std::vector<reg_t> CALLEE_SAVED_REGISTERS = {
+    {'s', 0}, {'s', 1}, {'s', 2}, {'s', 3}, {'s', 4},  {'s', 5},
+    {'s', 6}, {'s', 7}, {'s', 8}, {'s', 9}, {'s', 10}, {'s', 11},
+};
+
+namespace {
+
+struct ActiveInterval {
+  const LiveInterval *interval;
+  reg_t reg;
+};
+
+class LinearScan {
+private:
+  Allocation &alloc;
+  std::vector<reg_t> free_caller;
+  std::vector<reg_t> free_callee;
+  // Sorted by increasing end point
+  std::list<ActiveInterval> active;
+
+  void release(reg_t reg) {
+    auto is_caller = std::find(CALLER_SAVED_REGISTERS.begin(),
+                               CALLER_SAVED_REGISTERS.end(),
+                               reg) != CALLER_SAVED_REGISTERS.end();
+    auto &pool = is_caller ? free_caller : free_callee;
+    // Keep the preference order so allocation stays deterministic
+    pool.push_back(reg);
+    auto &order = is_caller ? CALLER_SAVED_REGISTERS : CALLEE_SAVED_REGISTERS;
+    std::sort(pool.begin(), pool.end(), [&](reg_t a, reg_t b) {
+      return std::find(order.begin(), order.end(), a) >
+             std::find(order.begin(), order.end(), b);
+    });
+  }
+
+  void expire(uint32_t start) {
+    while (!active.empty() && active.front().interval->end < start) {
+      release(active.front().reg);
+      active.pop_front();
+    }
+  }
+
+  void insert_active(const LiveInterval &interval, reg_t reg) {
+    auto it = active.begin();
+    while (it != active.end() && it->interval->end <= interval.end)
+      ++it;
+    active.insert(it, {&interval, reg});
+  }
+
+  void spill(const LiveInterval &interval) {
+    alloc.locations[interval.value] =
+        Location{Location::Kind::Stack, {}, 0};
+    alloc.spill_slots++;
+  }
+
+  void use_callee_saved(reg_t reg) {
+    if (std::find(alloc.callee_saved.begin(), alloc.callee_saved.end(), reg) ==
+        alloc.callee_saved.end())
+      alloc.callee_saved.push_back(reg);
+  }
+
+public:
+  explicit LinearScan(Allocation &alloc_) : alloc(alloc_) {
+    // Popped from the back, so store in reverse preference order
+    free_caller.assign(CALLER_SAVED_REGISTERS.rbegin(),
+                       CALLER_SAVED_REGISTERS.rend());
+    free_callee.assign(CALLEE_SAVED_REGISTERS.rbegin(),
+                       CALLEE_SAVED_REGISTERS.rend());
+  }
+
+  void run(const std::vector<LiveInterval> &intervals) {
+    for (auto const &interval : intervals) {
+      expire(interval.start);
+
+      // Caller-saved registers are clobbered by calls
+      std::vector<reg_t> *pool = nullptr;
+      if (!interval.crosses_call && !free_caller.empty())
+        pool = &free_caller;
+      else if (!free_callee.empty())
+        pool = &free_callee;
+
+      if (pool) {
+        reg_t reg = pool->back();
+        pool->pop_back();
+        if (pool == &free_callee)
+          use_callee_saved(reg);
+        alloc.locations[interval.value] =
+            Location{Location::Kind::Register, reg, 0};
+        insert_active(interval, reg);
+        continue;
+      }
+
+      // Out of registers: spill whichever of the current interval and the
+      // active one ending last lives longer, it blocks a register the most
+      auto victim = active.end();
+      for (auto it = active.begin(); it != active.end(); ++it) {
+        bool usable = !interval.crosses_call ||
+                      std::find(CALLEE_SAVED_REGISTERS.begin(),
+                                CALLEE_SAVED_REGISTERS.end(),
+                                it->reg) != CALLEE_SAVED_REGISTERS.end();
+        if (usable)
+          victim = it;
+      }
+
+      if (victim != active.end() && victim->interval->end > interval.end) {
+        reg_t reg = victim->reg;
+        spill(*victim->interval);
+        active.erase(victim);
+        alloc.locations[interval.value] =
+            Location{Location::Kind::Register, reg, 0};
+        insert_active(interval, reg);
+      } else {
+        spill(interval);
+      }
+    }
+  }
+};
+
+} // namespace
+
+Allocation LinearScanAllocator::allocate(koopa_raw_function_t func) const {
+  Allocation alloc;
+  LivenessInfo liveness = LivenessInfo::compute(func);
+  alloc.has_calls = !liveness.calls.empty();
+
+  LinearScan(alloc).run(liveness.intervals);
+
+  // Hand out slot offsets in interval order so the frame layout is stable
+  std::uint32_t slot = 0;
+  for (auto const &interval : liveness.intervals) {
+    auto &loc = alloc.locations[interval.value];
+    if (!loc.is_reg())
+      loc.offset = static_cast<std::int32_t>(4 * slot++);
+  }
+
+  return alloc;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "koopa.h"
+#include "liveness.hpp"
+#include "register.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Where a value lives for its whole lifetime
+struct Location {
+  enum class Kind { Register, Stack };
+
+  Kind kind;
+  reg_t reg;
+  // Offset from `sp` of the spill slot, for `Kind::Stack`
+  std::int32_t offset;
+
+  bool is_reg() const { return kind == Kind::Register; }
+};
+
+// Result of register allocation for one function
+struct Allocation {
+  std::unordered_map<koopa_raw_value_t, Location> locations;
+  // Callee-saved registers that are written and so must be preserved
+  std::vector<reg_t> callee_saved;
+  // Number of 4-byte spill slots
+  std::uint32_t spill_slots = 0;
+  bool has_calls = false;
+};
+
+class IRegisterAllocator {
+public:
+  virtual ~IRegisterAllocator() = default;
+
+  // Called concurrently for different functions of a program
+  virtual Allocation allocate(koopa_raw_function_t) const = 0;
+};
+
+// Registers handed out by the allocators, in order of preference. `t5` and
+// `t6` are not in here: the code generator keeps them free to load spilled
+// operands and materialise constants.
+extern const std::vector<reg_t> CALLER_SAVED_REGISTERS;
+extern const std::vector<reg_t> CALLEE_SAVED_REGISTERS;
+
+// Poletto & Sarkar linear scan over the intervals of `LivenessInfo`. Values
+// living across a call only get callee-saved registers; when nothing is free
+// the interval ending last is spilled to a stack slot.
+class LinearScanAllocator : public IRegisterAllocator {
+public:
+  Allocation allocate(koopa_raw_function_t) const override;
+};
+
+// Iterated register coalescing (George & Appel) over an interference graph
+// of the function's values. Slower than linear scan, but coalesces the value
+// returned by a function into `a0` and spills the values that are cheapest
+// by loop-depth weighted use counts. Spilled values go to stack slots that
+// the code generator accesses through its scratch registers, so no rewrite
+// and rebuild round is needed.
+class GraphColoringAllocator : public IRegisterAllocator {
+public:
+  Allocation allocate(koopa_raw_function_t) const override;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+struct reg_t {
+  char series;
+  int idx;
+
+  bool operator==(const reg_t &other) const {
+    return (series == other.series && idx == other.idx);
+  }
+
+  bool operator!=(const reg_t &other) const { return !(*this == other); }
+
+  // Assembly name of the register, from a static table
+  std::string_view name() const {
+    static constexpr std::string_view X[] = {
+        "x0",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",
+        "x8",  "x9",  "x10", "x11", "x12", "x13", "x14", "x15",
+        "x16", "x17", "x18", "x19", "x20", "x21", "x22", "x23",
+        "x24", "x25", "x26", "x27", "x28", "x29", "x30", "x31"};
+    static constexpr std::string_view T[] = {"t0", "t1", "t2", "t3",
+                                             "t4", "t5", "t6"};
+    static constexpr std::string_view A[] = {"a0", "a1", "a2", "a3",
+                                             "a4", "a5", "a6", "a7"};
+    static constexpr std::string_view S[] = {"s0", "s1", "s2",  "s3",
+                                             "s4", "s5", "s6",  "s7",
+                                             "s8", "s9", "s10", "s11"};
+    switch (series) {
+    case 'x':
+      return X[idx];
+    case 't':
+      return T[idx];
+    case 'a':
+      return A[idx];
+    case 's':
+      return S[idx];
+    default:
+      return "??";
+    }
+  }
+
+  std::string to_string() const { return std::string(name()); }
+};
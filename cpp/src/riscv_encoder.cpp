@@ -0,0 +1,260 @@
+#include "riscv_encoder.hpp"
+#include "logger.hpp"
+
+// Major opcodes of the base instruction formats
+static constexpr std::uint32_t OPCODE_OP = 0x33;
+static constexpr std::uint32_t OPCODE_OP_IMM = 0x13;
+static constexpr std::uint32_t OPCODE_LOAD = 0x03;
+static constexpr std::uint32_t OPCODE_STORE = 0x23;
+static constexpr std::uint32_t OPCODE_BRANCH = 0x63;
+static constexpr std::uint32_t OPCODE_LUI = 0x37;
+static constexpr std::uint32_t OPCODE_JAL = 0x6f;
+static constexpr std::uint32_t OPCODE_JALR = 0x67;
+
+static std::uint32_t reg_number(MReg reg) {
+  if (reg.is_virtual()) {
+    LOG_ERROR("Virtual register left in machine code.");
+  }
+  return reg.index();
+}
+
+static std::uint32_t r_type(std::uint32_t funct7, MReg rs2, MReg rs1,
+                            std::uint32_t funct3, MReg rd) {
+  return funct7 << 25 | reg_number(rs2) << 20 | reg_number(rs1) << 15 |
+         funct3 << 12 | reg_number(rd) << 7 | OPCODE_OP;
+}
+
+static std::uint32_t i_type(std::int32_t imm, MReg rs1, std::uint32_t funct3,
+                            MReg rd, std::uint32_t opcode = OPCODE_OP_IMM) {
+  return (static_cast<std::uint32_t>(imm) & 0xfff) << 20 |
+         reg_number(rs1) << 15 | funct3 << 12 | reg_number(rd) << 7 | opcode;
+}
+
+static std::uint32_t s_type(std::int32_t imm, MReg rs2, MReg rs1,
+                            std::uint32_t funct3) {
+  auto u = static_cast<std::uint32_t>(imm);
+  return (u >> 5 & 0x7f) << 25 | reg_number(rs2) << 20 |
+         reg_number(rs1) << 15 | funct3 << 12 | (u & 0x1f) << 7 |
+         OPCODE_STORE;
+}
+
+static std::uint32_t b_type(std::int32_t offset, MReg rs2, MReg rs1,
+                            std::uint32_t funct3) {
+  if (offset < -4096 || offset > 4094) {
+    LOG_ERROR("Branch target out of range.");
+  }
+  auto u = static_cast<std::uint32_t>(offset);
+  return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | reg_number(rs2) << 20 |
+         reg_number(rs1) << 15 | funct3 << 12 | (u >> 1 & 0xf) << 8 |
+         (u >> 11 & 1) << 7 | OPCODE_BRANCH;
+}
+
+static std::uint32_t u_type(std::int32_t imm20, MReg rd) {
+  return (static_cast<std::uint32_t>(imm20) & 0xfffff) << 12 |
+         reg_number(rd) << 7 | OPCODE_LUI;
+}
+
+static std::uint32_t j_type(std::int32_t offset, MReg rd) {
+  if (offset < -(1 << 20) || offset >= (1 << 20)) {
+    LOG_ERROR("Jump target out of range.");
+  }
+  auto u = static_cast<std::uint32_t>(offset);
+  return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 |
+         (u >> 12 & 0xff) << 12 | reg_number(rd) << 7 | OPCODE_JAL;
+}
+
+// `li` beyond 12 bits takes `lui` + `addi`, or only `lui` if the lower 12
+// bits are zero, as with the assembler and `CodeGenUnit::emit_li`
+static std::uint32_t li_size(const MInst &inst) {
+  return inst.op == MOp::LI && !fits_imm12(inst.imm) &&
+                 split_imm32(inst.imm).lo != 0
+             ? 8
+             : 4;
+}
+
+static void put_word(std::vector<std::uint8_t> &text, std::uint32_t word) {
+  for (int i = 0; i < 4; i++) {
+    text.push_back(static_cast<std::uint8_t>(word >> (8 * i)));
+  }
+}
+
+// Instruction words of `inst` at `pc`, with `block_offsets` the addresses of
+// the function's blocks
+static void encode_inst(std::vector<std::uint8_t> &text, const MInst &inst,
+                        std::uint32_t pc,
+                        const std::vector<std::uint32_t> &block_offsets) {
+  auto branch_offset = [&]() -> std::int32_t {
+    if (inst.imm < 0 ||
+        static_cast<std::size_t>(inst.imm) >= block_offsets.size()) {
+      LOG_ERROR("Branch to a block that does not exist.");
+    }
+    return static_cast<std::int32_t>(block_offsets[inst.imm] - pc);
+  };
+  MReg rd = inst.rd, rs1 = inst.rs1, rs2 = inst.rs2;
+
+  std::uint32_t word;
+  switch (inst.op) {
+  case MOp::ADD:
+    word = r_type(0x00, rs2, rs1, 0, rd);
+    break;
+  case MOp::SUB:
+    word = r_type(0x20, rs2, rs1, 0, rd);
+    break;
+  case MOp::MUL:
+    word = r_type(0x01, rs2, rs1, 0, rd);
+    break;
+  case MOp::MULH:
+    word = r_type(0x01, rs2, rs1, 1, rd);
+    break;
+  case MOp::DIV:
+    word = r_type(0x01, rs2, rs1, 4, rd);
+    break;
+  case MOp::REM:
+    word = r_type(0x01, rs2, rs1, 6, rd);
+    break;
+  case MOp::AND:
+    word = r_type(0x00, rs2, rs1, 7, rd);
+    break;
+  case MOp::OR:
+    word = r_type(0x00, rs2, rs1, 6, rd);
+    break;
+  case MOp::XOR:
+    word = r_type(0x00, rs2, rs1, 4, rd);
+    break;
+  case MOp::SLL:
+    word = r_type(0x00, rs2, rs1, 1, rd);
+    break;
+  case MOp::SRL:
+    word = r_type(0x00, rs2, rs1, 5, rd);
+    break;
+  case MOp::SRA:
+    word = r_type(0x20, rs2, rs1, 5, rd);
+    break;
+  case MOp::SLT:
+    word = r_type(0x00, rs2, rs1, 2, rd);
+    break;
+  case MOp::ADDI:
+    word = i_type(inst.imm, rs1, 0, rd);
+    break;
+  case MOp::ANDI:
+    word = i_type(inst.imm, rs1, 7, rd);
+    break;
+  case MOp::ORI:
+    word = i_type(inst.imm, rs1, 6, rd);
+    break;
+  case MOp::XORI:
+    word = i_type(inst.imm, rs1, 4, rd);
+    break;
+  case MOp::SLLI:
+    word = i_type(inst.imm & 31, rs1, 1, rd);
+    break;
+  case MOp::SRLI:
+    word = i_type(inst.imm & 31, rs1, 5, rd);
+    break;
+  case MOp::SRAI:
+    word = i_type(0x400 | (inst.imm & 31), rs1, 5, rd);
+    break;
+  case MOp::SLTI:
+    word = i_type(inst.imm, rs1, 2, rd);
+    break;
+  // Pseudo-instructions, as the assembler expands them
+  case MOp::MV:
+    word = i_type(0, rs1, 0, rd);
+    break;
+  case MOp::NEG:
+    word = r_type(0x20, rs1, MREG_ZERO, 0, rd);
+    break;
+  case MOp::NOT:
+    word = i_type(-1, rs1, 4, rd);
+    break;
+  case MOp::SEQZ:
+    // sltiu rd, rs, 1
+    word = i_type(1, rs1, 3, rd);
+    break;
+  case MOp::SNEZ:
+    // sltu rd, x0, rs
+    word = r_type(0x00, rs1, MREG_ZERO, 3, rd);
+    break;
+  case MOp::LI: {
+    if (fits_imm12(inst.imm)) {
+      word = i_type(inst.imm, MREG_ZERO, 0, rd);
+      break;
+    }
+    ImmSplit split = split_imm32(inst.imm);
+    if (split.lo == 0) {
+      word = u_type(split.hi, rd);
+      break;
+    }
+    put_word(text, u_type(split.hi, rd));
+    word = i_type(split.lo, rd, 0, rd);
+    break;
+  }
+  case MOp::LUI:
+    word = u_type(inst.imm, rd);
+    break;
+  case MOp::LW:
+    word = i_type(inst.imm, rs1, 2, rd, OPCODE_LOAD);
+    break;
+  case MOp::SW:
+    word = s_type(inst.imm, rs2, rs1, 2);
+    break;
+  case MOp::BEQ:
+    word = b_type(branch_offset(), rs2, rs1, 0);
+    break;
+  case MOp::BNE:
+    word = b_type(branch_offset(), rs2, rs1, 1);
+    break;
+  case MOp::BLT:
+    word = b_type(branch_offset(), rs2, rs1, 4);
+    break;
+  case MOp::BGE:
+    word = b_type(branch_offset(), rs2, rs1, 5);
+    break;
+  case MOp::BEQZ:
+    word = b_type(branch_offset(), MREG_ZERO, rs1, 0);
+    break;
+  case MOp::BNEZ:
+    word = b_type(branch_offset(), MREG_ZERO, rs1, 1);
+    break;
+  case MOp::J:
+    word = j_type(branch_offset(), MREG_ZERO);
+    break;
+  case MOp::RET:
+    // jalr x0, 0(ra)
+    word = i_type(0, MREG_RA, 0, MREG_ZERO, OPCODE_JALR);
+    break;
+  default:
+    LOG_ERROR("Unknown machine instruction.");
+  }
+  put_word(text, word);
+}
+
+ObjectCode encode_program(const MProgram &program) {
+  ObjectCode code;
+  std::vector<std::uint32_t> block_offsets;
+  for (auto const &func : program.functions) {
+    auto start = static_cast<std::uint32_t>(code.text.size());
+
+    // Block addresses first, branches may go forward
+    block_offsets.clear();
+    std::uint32_t pc = start;
+    for (auto const &block : func.blocks) {
+      block_offsets.push_back(pc);
+      for (auto i = block.begin; i < block.end; i++) {
+        pc += li_size(func.insts[i]);
+      }
+    }
+
+    for (auto const &block : func.blocks) {
+      for (auto i = block.begin; i < block.end; i++) {
+        encode_inst(code.text, func.insts[i],
+                    static_cast<std::uint32_t>(code.text.size()),
+                    block_offsets);
+      }
+    }
+
+    auto size = static_cast<std::uint32_t>(code.text.size()) - start;
+    code.symbols.push_back({func.name, start, size, func.name == "main"});
+  }
+  return code;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "mir.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Machine code of a program, ready to be written into an object file
+struct ObjectCode {
+  struct Symbol {
+    std::string name;
+    // Byte range of the function in `text`
+    std::uint32_t offset;
+    std::uint32_t size;
+    bool global;
+  };
+
+  // Places in `text` the linker patches with the address of a symbol
+  struct Relocation {
+    std::uint32_t offset;
+    // Index into `symbols`
+    std::uint32_t symbol;
+    std::uint32_t type;
+    std::int32_t addend;
+  };
+
+  std::vector<std::uint8_t> text;
+  std::vector<Symbol> symbols;
+  std::vector<Relocation> relocations;
+};
+
+// Encodes the program as RV32IM machine code, the same instructions the
+// assembler makes of the printed assembly. Branches within a function are
+// resolved here; `main` is the only global symbol, as in the assembly.
+// Throws if the MIR still has virtual registers or a branch out of range.
+ObjectCode encode_program(const MProgram &program);
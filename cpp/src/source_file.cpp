@@ -0,0 +1,77 @@
+#include "source_file.hpp"
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOURCE_FILE_MMAP 1
+#endif
+
+// Room for flex's two end-of-buffer NULs
+static constexpr std::size_t PADDING = 2;
+
+std::unique_ptr<SourceFile> SourceFile::open(const std::string &path) {
+  std::unique_ptr<SourceFile> file(new SourceFile());
+
+#ifdef SOURCE_FILE_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+
+  // Reserve zeroed anonymous memory for text plus padding and map the file
+  // over its start. The padding then reads as NUL even when the text ends
+  // exactly on a page boundary, where a file mapping alone would fault.
+  std::size_t total = size + PADDING;
+  void *mem = mmap(nullptr, total, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    close(fd);
+    return nullptr;
+  }
+  if (size > 0 &&
+      mmap(mem, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(mem, total);
+    close(fd);
+    return nullptr;
+  }
+  close(fd);
+
+  file->base = static_cast<char *>(mem);
+  file->text_size = size;
+  file->mapped_size = total;
+  return file;
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+    return nullptr;
+  std::size_t size = static_cast<std::size_t>(in.tellg());
+  in.seekg(0);
+
+  file->owned.reset(new char[size + PADDING]);
+  if (!in.read(file->owned.get(), static_cast<std::streamsize>(size)))
+    return nullptr;
+  std::memset(file->owned.get() + size, 0, PADDING);
+
+  file->base = file->owned.get();
+  file->text_size = size;
+  return file;
+#endif
+}
+
+SourceFile::~SourceFile() {
+#ifdef SOURCE_FILE_MMAP
+  if (mapped_size)
+    munmap(base, mapped_size);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// The whole text of one input file in memory, followed by the two NUL bytes
+// flex's `yy_scan_buffer` needs to scan it in place. Where available the file
+// is mapped privately rather than read: the scanner only dirties the pages it
+// writes its temporary terminators to. Token text handed out by the scanner
+// points into this buffer, so it must outlive the AST of the unit.
+class SourceFile {
+private:
+  char *base = nullptr;
+  std::size_t text_size = 0;
+  // Bytes of the mapping, 0 if `base` was allocated instead
+  std::size_t mapped_size = 0;
+  std::unique_ptr<char[]> owned;
+
+  SourceFile() = default;
+
+public:
+  // Returns nullptr if the file cannot be opened or read
+  static std::unique_ptr<SourceFile> open(const std::string &path);
+
+  ~SourceFile();
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+
+  // Text followed by two NUL bytes, writable for the scanner
+  char *data() { return base; }
+  // Length of the text, without the NULs
+  std::size_t size() const { return text_size; }
+};
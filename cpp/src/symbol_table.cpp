@@ -0,0 +1,35 @@
+#include "symbol_table.hpp"
+#include <cstring>
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto it = ids.find(name);
+  if (it != ids.end())
+    return Symbol{it->second};
+
+  // The key views the arena copy, not the caller's text
+  std::string_view stored(arena.CopyString(name), name.size());
+  auto id = static_cast<std::uint32_t>(names.size());
+  names.push_back(stored);
+  ids.emplace(stored, id);
+  return Symbol{id};
+}
+
+Symbol SymbolTable::intern(std::string_view prefix, std::string_view name) {
+  // Assemble the name in the arena. If it is already known the copy is simply
+  // left unused, which only happens for repeated declarations.
+  auto *text =
+      static_cast<char *>(arena.Allocate(prefix.size() + name.size() + 1, 1));
+  std::memcpy(text, prefix.data(), prefix.size());
+  std::memcpy(text + prefix.size(), name.data(), name.size());
+  text[prefix.size() + name.size()] = '\0';
+  std::string_view joined(text, prefix.size() + name.size());
+
+  auto it = ids.find(joined);
+  if (it != ids.end())
+    return Symbol{it->second};
+
+  auto id = static_cast<std::uint32_t>(names.size());
+  names.push_back(joined);
+  ids.emplace(joined, id);
+  return Symbol{id};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "arena.hpp"
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Dense ID of a name interned in a `SymbolTable`. Within one table two symbols
+// are equal exactly when their names are, so comparing and hashing names is
+// integer work.
+struct Symbol {
+  static constexpr std::uint32_t NONE = UINT32_MAX;
+
+  std::uint32_t id = NONE;
+
+  bool valid() const { return id != NONE; }
+  bool operator==(Symbol other) const { return id == other.id; }
+  bool operator!=(Symbol other) const { return id != other.id; }
+};
+
+namespace std {
+template <> struct hash<Symbol> {
+  std::size_t operator()(Symbol s) const noexcept { return s.id; }
+};
+} // namespace std
+
+// Names of one translation unit. Each distinct name is stored once, with a
+// trailing NUL, in the table's arena and handed out as the next ID.
+class SymbolTable {
+private:
+  Arena arena;
+  std::vector<std::string_view> names;
+  std::unordered_map<std::string_view, std::uint32_t> ids;
+
+public:
+  SymbolTable() = default;
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+  Symbol intern(std::string_view name);
+  // `prefix` followed by `name`, e.g. the `@` of Koopa function names
+  Symbol intern(std::string_view prefix, std::string_view name);
+
+  std::string_view name(Symbol symbol) const { return names[symbol.id]; }
+  const char *c_str(Symbol symbol) const { return names[symbol.id].data(); }
+
+  std::size_t size() const { return names.size(); }
+};
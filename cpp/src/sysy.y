@@ -1,28 +1,56 @@
 %code requires {
-  #include <memory>
-  #include <string>
+  #include "arena.hpp"
   #include "c_ast.hpp"
+
+  #include <cstddef>
+  #include <string>
+
+  // State of one reentrant flex scanner, the generated lexer declares the
+  // same type
+  typedef void *yyscan_t;
+
+  // Token text inside the scanned `SourceFile`, which outlives the AST. A
+  // plain struct, as `std::string_view` is not trivial enough for the union.
+  struct StrRef {
+    const char *data;
+    std::size_t size;
+  };
 }
 
-%{
+%code {
 
-#include <iostream>
-#include <memory>
 #include <string>
+#include "arena.hpp"
 #include "c_ast.hpp"
+#include "parser.hpp"
+#include "source_file.hpp"
 
 // Declare lexer function and error handling
-int yylex();
-void yyerror(std::unique_ptr<c_ast::BaseAST> &ast, const char *s);
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+void yyerror(c_ast::BaseAST *&ast, yyscan_t scanner, Arena &arena,
+             std::string &error, const char *s);
+
+// Nesting depth is only limited by this, as the parser stacks live on the
+// heap and grow on demand (e.g. `UnaryOp UnaryExp` shifts every operator of a
+// `- - - ... 1` chain before reducing).
+#define YYMAXDEPTH (1 << 22)
 
 using namespace std;
 
-%}
+}
 
-%parse-param { std::unique_ptr<c_ast::BaseAST> &ast }
+// Neither the parser nor the scanner keep global state, so several units can
+// be parsed at once on different threads. All AST nodes are allocated from
+// `arena`, which the caller keeps alive for as long as it uses `ast`. A
+// syntax error is left in `error` for the caller to report.
+%define api.pure full
+%parse-param { c_ast::BaseAST *&ast }
+%param { yyscan_t scanner }
+%parse-param { Arena &arena }
+%parse-param { std::string &error }
 
 %union {
-  std::string *str_val;
+  StrRef str_val;
   int int_val;
   c_ast::UnaryOp op_val;
   c_ast::BaseAST *ast_val;
@@ -36,48 +64,45 @@ using namespace std;
 %type <int_val> Number
 %type <op_val> UnaryOp
 
-%destructor { delete $$; } <ast_val>
-%destructor { delete $$; } <str_val>
-
 %%
 
 CompUnit
   : FuncDef {
-    auto comp_unit = std::make_unique<c_ast::CompUnitAST>();
-    comp_unit->func_def = unique_ptr<c_ast::BaseAST>($1);
-    ast = std::move(comp_unit);
+    auto comp_unit = arena.New<c_ast::CompUnitAST>();
+    comp_unit->func_def = $1;
+    ast = comp_unit;
   }
   ;
 
 FuncDef
   : FuncType IDENT '(' ')' Block {
-    auto ast_node = new c_ast::FuncDefAST();
-    ast_node->func_type = unique_ptr<c_ast::BaseAST>($1);
-    ast_node->ident = *$2; delete $2;
-    ast_node->block = unique_ptr<c_ast::BaseAST>($5);
+    auto ast_node = arena.New<c_ast::FuncDefAST>();
+    ast_node->func_type = $1;
+    ast_node->ident = std::string_view($2.data, $2.size);
+    ast_node->block = $5;
     $$ = ast_node;
   }
   ;
 
 FuncType
   : INT {
-    $$ = new c_ast::FuncTypeAST();
+    $$ = arena.New<c_ast::FuncTypeAST>();
   }
   ;
 
 Block
   : '{' Stmt '}' {
-    auto ast_node = new c_ast::BlockAST();
-    ast_node->stmt = unique_ptr<c_ast::BaseAST>($2);
+    auto ast_node = arena.New<c_ast::BlockAST>();
+    ast_node->stmt = $2;
     $$ = ast_node;
   }
   ;
 
 Stmt
   : RETURN Exp ';' {
-    auto ast_node = new c_ast::StmtAST();
+    auto ast_node = arena.New<c_ast::StmtAST>();
     
-    ast_node->exp = std::unique_ptr<c_ast::BaseAST>($2);
+    ast_node->exp = $2;
 
     $$ = ast_node;
   }
@@ -85,27 +110,27 @@ Stmt
 
 Exp
   : UnaryExp {
-    auto ast_node = new c_ast::ExpAST();
+    auto ast_node = arena.New<c_ast::ExpAST>();
 
-    ast_node->unary_exp = std::unique_ptr<c_ast::BaseAST>($1);
+    ast_node->unary_exp = $1;
 
     $$ = ast_node;
   }
 
 PrimaryExp
   : '(' Exp ')' {
-    auto ast_node = new c_ast::PrimaryASTExp();
+    auto ast_node = arena.New<c_ast::PrimaryASTExp>();
     
-    ast_node->exp = std::unique_ptr<c_ast::BaseAST>($2);
+    ast_node->exp = $2;
 
     $$ = ast_node;
   }
   | Number {
-    auto ast_node = new c_ast::PrimaryASTNumber();
+    auto ast_node = arena.New<c_ast::PrimaryASTNumber>();
     
-    auto num = std::make_unique<c_ast::NumberAST>();
+    auto num = arena.New<c_ast::NumberAST>();
     num->int_val = $1;
-    ast_node->number = std::move(num);
+    ast_node->number = num;
 
     $$ = ast_node;
   }
@@ -118,17 +143,17 @@ Number
 
 UnaryExp
   : PrimaryExp {
-    auto ast_node = new c_ast::UnaryExpASTPrimary();
+    auto ast_node = arena.New<c_ast::UnaryExpASTPrimary>();
     
-    ast_node->primary_exp = std::unique_ptr<c_ast::BaseAST>($1);
+    ast_node->primary_exp = $1;
 
     $$ = ast_node;
   } 
   | UnaryOp UnaryExp {
-    auto ast_node = new c_ast::UnaryExpASTOpUnary();
+    auto ast_node = arena.New<c_ast::UnaryExpASTOpUnary>();
 
     ast_node->unary_op = $1;
-    ast_node->unary_exp = std::unique_ptr<c_ast::BaseAST>($2);
+    ast_node->unary_exp = $2;
 
     $$ = ast_node;
   }
@@ -149,6 +174,34 @@ UnaryOp
 
 %%
 
-void yyerror(unique_ptr<c_ast::BaseAST> &ast, const char *s) {
-  cerr << "error: " << s << endl;
+void yyerror(c_ast::BaseAST *&ast, yyscan_t scanner, Arena &arena,
+             std::string &error, const char *s) {
+  error = s;
+}
+
+// Defined by the reentrant flex scanner
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+int yylex_init(yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+
+c_ast::BaseAST *parse_unit(SourceFile &source, Arena &arena,
+                           std::string &error) {
+  yyscan_t scanner;
+  if (yylex_init(&scanner)) {
+    error = "unable to create the scanner";
+    return nullptr;
+  }
+  // Scan the text in place, flex needs the two NULs after it in the buffer.
+  // The buffer is released along with the scanner.
+  if (!yy_scan_buffer(source.data(), source.size() + 2, scanner)) {
+    yylex_destroy(scanner);
+    error = "unable to scan the source in place";
+    return nullptr;
+  }
+
+  c_ast::BaseAST *ast = nullptr;
+  int ret = yyparse(ast, scanner, arena, error);
+  yylex_destroy(scanner);
+  return ret ? nullptr : ast;
 }
@@ -0,0 +1,102 @@
+#include "thread_pool.hpp"
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+  if (threads == 0)
+    threads = 1;
+  for (unsigned i = 0; i < threads; i++)
+    queues.push_back(std::make_unique<Queue>());
+  for (unsigned i = 0; i < threads; i++)
+    workers.emplace_back([this, i] { run_worker(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void WorkStealingPool::submit(Task task) {
+  Queue &queue = *queues[next_queue];
+  next_queue = (next_queue + 1) % queues.size();
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued++;
+    unfinished++;
+  }
+  work_available.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  all_done.wait(lock, [this] { return unfinished == 0; });
+  if (error) {
+    auto e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+bool WorkStealingPool::try_pop(std::size_t self, Task &task) {
+  // Own deque first, newest task
+  {
+    Queue &own = *queues[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  // Then steal the oldest task of another worker
+  for (std::size_t i = 1; i < queues.size(); i++) {
+    Queue &victim = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::run_worker(std::size_t self) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work_available.wait(lock, [this] { return stopping || queued > 0; });
+      if (queued == 0)
+        return;
+      // Claim one task, only claimed tasks are ever popped
+      queued--;
+    }
+
+    // There are at least as many tasks in the deques as claims, but another
+    // worker may take the one a scan passes by, so scan until one is found
+    Task task;
+    while (!try_pop(self, task)) {
+      std::this_thread::yield();
+    }
+
+    std::exception_ptr task_error;
+    try {
+      task();
+    } catch (...) {
+      task_error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task_error && !error)
+      error = task_error;
+    if (--unfinished == 0)
+      all_done.notify_all();
+  }
+}
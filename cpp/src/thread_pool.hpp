@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. Submitted tasks are
+// spread round-robin over the deques; a worker runs tasks from the back of
+// its own deque and, once that is empty, steals from the front of the
+// others, so uneven tasks (e.g. one huge function among small ones) still
+// keep every thread busy.
+class WorkStealingPool {
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(unsigned threads);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  void submit(Task task);
+
+  // Blocks until every submitted task has finished. Rethrows the first
+  // exception a task threw, if any.
+  void wait();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::size_t next_queue = 0;
+
+  // Guards the counters below and backs both condition variables
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable all_done;
+  std::size_t queued = 0;
+  std::size_t unfinished = 0;
+  bool stopping = false;
+  std::exception_ptr error;
+
+  bool try_pop(std::size_t self, Task &task);
+  void run_worker(std::size_t self);
+};
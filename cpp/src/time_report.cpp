@@ -0,0 +1,164 @@
+#include "time_report.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Count every allocation of the program by replacing the global allocation
+// functions. The counters are per thread, which keeps them cheap enough to
+// leave always on and attributes allocations to the phase running on the
+// thread that made them.
+static thread_local std::uint64_t num_allocations = 0;
+static thread_local std::uint64_t num_allocated_bytes = 0;
+
+static void *counted_malloc(std::size_t size) {
+  num_allocations++;
+  num_allocated_bytes += size;
+  return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size) {
+  if (void *p = counted_malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return ::operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_malloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_malloc(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+std::uint64_t allocation_count() { return num_allocations; }
+
+std::uint64_t allocated_bytes() { return num_allocated_bytes; }
+
+std::uint64_t peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+  // Linux reports kilobytes
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+TimeReport::Scope::Scope(TimeReport *report_, std::string_view name_)
+    : report(report_), name(name_) {
+  if (!report)
+    return;
+  start_allocations = allocation_count();
+  start_bytes = allocated_bytes();
+  start = std::chrono::steady_clock::now();
+}
+
+TimeReport::Scope::~Scope() {
+  if (!report)
+    return;
+  auto end = std::chrono::steady_clock::now();
+  Entry entry{
+      name,
+      std::chrono::duration<double>(end - start).count(),
+      allocation_count() - start_allocations,
+      allocated_bytes() - start_bytes,
+      peak_rss_bytes(),
+  };
+
+  // A phase run again, e.g. for the next unit of a batch, adds to its total.
+  // With parallel units the times of all threads are summed up.
+  std::lock_guard<std::mutex> lock(report->mutex);
+  for (auto &e : report->phases) {
+    if (e.name == name) {
+      e.seconds += entry.seconds;
+      e.allocations += entry.allocations;
+      e.allocated_bytes += entry.allocated_bytes;
+      e.peak_rss_bytes = entry.peak_rss_bytes;
+      return;
+    }
+  }
+  report->phases.push_back(entry);
+}
+
+void TimeReport::count(std::string_view name, std::uint64_t value) {
+  if (!enabled)
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &[counter, total] : counters) {
+    if (counter == name) {
+      total += value;
+      return;
+    }
+  }
+  counters.emplace_back(name, value);
+}
+
+void TimeReport::print(std::ostream &out) const {
+  double total = 0;
+  for (auto const &e : phases)
+    total += e.seconds;
+
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-20s %12s %7s %12s %14s %12s\n",
+                "phase", "wall (ms)", "%", "allocs", "alloc bytes",
+                "peak RSS KiB");
+  out << line;
+  for (auto const &e : phases) {
+    std::snprintf(line, sizeof(line),
+                  "%-20.*s %12.3f %6.1f%% %12llu %14llu %12llu\n",
+                  static_cast<int>(e.name.size()), e.name.data(),
+                  e.seconds * 1e3, total > 0 ? 100 * e.seconds / total : 0.0,
+                  static_cast<unsigned long long>(e.allocations),
+                  static_cast<unsigned long long>(e.allocated_bytes),
+                  static_cast<unsigned long long>(e.peak_rss_bytes / 1024));
+    out << line;
+  }
+  std::snprintf(line, sizeof(line), "%-20s %12.3f\n", "total", total * 1e3);
+  out << line;
+
+  for (auto const &[name, value] : counters) {
+    std::snprintf(line, sizeof(line), "%-33.*s %12llu\n",
+                  static_cast<int>(name.size()), name.data(),
+                  static_cast<unsigned long long>(value));
+    out << line;
+  }
+}
+
+void TimeReport::print_json(std::ostream &out) const {
+  // Phase and counter names are chosen in the driver, no escaping needed
+  out << "{\"phases\": [";
+  for (size_t i = 0; i < phases.size(); i++) {
+    auto const &e = phases[i];
+    if (i)
+      out << ", ";
+    out << "{\"name\": \"" << e.name << "\", \"seconds\": " << e.seconds
+        << ", \"allocations\": " << e.allocations
+        << ", \"allocated_bytes\": " << e.allocated_bytes
+        << ", \"peak_rss_bytes\": " << e.peak_rss_bytes << "}";
+  }
+  out << "], \"counters\": {";
+  for (size_t i = 0; i < counters.size(); i++) {
+    if (i)
+      out << ", ";
+    out << "\"" << counters[i].first << "\": " << counters[i].second;
+  }
+  out << "}}\n";
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Wall time, heap allocations and peak RSS of each compiler phase, printed
+// with `-ftime-report` (or `-ftime-report=json`), along with counters of
+// what the passes did. Repeated phases and counters, such as those of every
+// unit in a batch, are summed up.
+//
+//   TimeReport report(true);
+//   {
+//     auto phase = report.phase("parse");
+//     ...
+//   }
+//   report.print(std::cerr);
+class TimeReport {
+public:
+  struct Entry {
+    std::string_view name;
+    double seconds;
+    std::uint64_t allocations;
+    std::uint64_t allocated_bytes;
+    // Peak resident set of the process when the phase ended
+    std::uint64_t peak_rss_bytes;
+  };
+
+  // Records one phase from construction until destruction
+  class Scope {
+  private:
+    TimeReport *report;
+    std::string_view name;
+    std::chrono::steady_clock::time_point start;
+    std::uint64_t start_allocations;
+    std::uint64_t start_bytes;
+
+  public:
+    Scope(TimeReport *report_, std::string_view name_);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  explicit TimeReport(bool enabled_) : enabled(enabled_) {}
+
+  bool is_enabled() const { return enabled; }
+
+  // A disabled report hands out scopes that record nothing
+  Scope phase(std::string_view name) {
+    return Scope(enabled ? this : nullptr, name);
+  }
+
+  const std::vector<Entry> &entries() const { return phases; }
+
+  // Adds `value` to the counter `name`, e.g. instructions removed by a pass
+  void count(std::string_view name, std::uint64_t value);
+
+  void print(std::ostream &out) const;
+  void print_json(std::ostream &out) const;
+
+private:
+  bool enabled;
+  // Scopes may end on several threads at once
+  std::mutex mutex;
+  std::vector<Entry> phases;
+  std::vector<std::pair<std::string_view, std::uint64_t>> counters;
+};
+
+// Heap allocations made through the global `operator new` so far by the
+// calling thread
+std::uint64_t allocation_count();
+std::uint64_t allocated_bytes();
+std::uint64_t peak_rss_bytes();
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <iostream>
+
+// Checks for the test executables: a failed check is reported with its
+// location and counted, `main` returns `test_status()`.
+
+inline int &test_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+// `CHECK(cond) << context...` prints the context only if `cond` fails
+#define CHECK(cond)                                                            \
+  if (cond) {                                                                  \
+  } else                                                                       \
+    (test_failures()++,                                                        \
+     std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond " ")
+
+inline int test_status() {
+  if (test_failures() == 0) {
+    return 0;
+  }
+  std::cerr << test_failures() << " check(s) failed\n";
+  return 1;
+}
@@ -0,0 +1,231 @@
+// Runs straight-line koopa_ast programs through the backend and executes the
+// machine IR, checking each result against the constant folder. Every binary
+// operator is tried with constants at the edges of the immediate forms and
+// of the strength-reduced multiplications and divisions, with constants on
+// either side and with both operands in registers, under both register
+// allocators. Enough values stay live at once to spill, and the random
+// programs are lowered with several jobs.
+
+#include "check.hpp"
+#include "codegen.hpp"
+#include "const_fold.hpp"
+#include "mir_machine.hpp"
+#include "raw_builder.hpp"
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace koopa_ast;
+
+namespace {
+
+constexpr std::pair<BinaryOp, const char *> OPS[] = {
+    {BinaryOp::NotEq, "ne"}, {BinaryOp::Eq, "eq"},   {BinaryOp::Gt, "gt"},
+    {BinaryOp::Lt, "lt"},    {BinaryOp::Ge, "ge"},   {BinaryOp::Le, "le"},
+    {BinaryOp::Add, "add"},  {BinaryOp::Sub, "sub"}, {BinaryOp::Mul, "mul"},
+    {BinaryOp::Div, "div"},  {BinaryOp::Mod, "mod"}, {BinaryOp::And, "and"},
+    {BinaryOp::Or, "or"},    {BinaryOp::Xor, "xor"}, {BinaryOp::Shl, "shl"},
+    {BinaryOp::Shr, "shr"},  {BinaryOp::Sar, "sar"},
+};
+
+// Register operands, and the constants that go with them
+const std::vector<std::int32_t> VALUES = {
+    INT32_MIN, INT32_MIN + 1, -65537, -2049, -2048, -641, -7, -3, -2, -1, 0,
+    1,         2,             3,      7,     31,    32,   641, 2047, 2048,
+    4096,      65535,         123456789, 1 << 30, INT32_MAX,
+};
+const std::vector<std::int32_t> CONSTANTS = [] {
+  std::vector<std::int32_t> constants = VALUES;
+  for (int k : {4, 11, 12, 16, 31}) {
+    std::uint32_t p = 1u << k;
+    for (std::uint32_t c : {p, p - 1, p + 1, 0u - p}) {
+      constants.push_back(static_cast<std::int32_t>(c));
+    }
+  }
+  for (std::int32_t c : {5, 9, 10, 100, 1000, 2046, 2049, 100000, -100000}) {
+    constants.push_back(c);
+  }
+  return constants;
+}();
+
+enum class Alloc { LinearScan, GraphColoring };
+
+const char *name(Alloc alloc) {
+  return alloc == Alloc::LinearScan ? "linear scan" : "graph coloring";
+}
+
+// A function under construction, with the value of every instruction
+class FunctionBuilder {
+private:
+  Program &prog;
+  std::unique_ptr<Function> func;
+  std::unique_ptr<BasicBlock> bb;
+  std::vector<std::pair<Value *, std::int32_t>> results;
+
+public:
+  FunctionBuilder(Program &_prog, const std::string &name)
+      : prog(_prog), func(std::make_unique<Function>()),
+        bb(std::make_unique<BasicBlock>(prog.symbols.intern("%entry"))) {
+    func->name = prog.symbols.intern(name);
+    func->type = std::make_unique<Type>(Type::I32());
+  }
+
+  std::pair<Value *, std::int32_t> constant(std::int32_t value) {
+    return {bb->Make<Integer>(false, value), value};
+  }
+  // `value` computed into a register: codegen does not fold `c - 0`
+  std::pair<Value *, std::int32_t> reg(std::int32_t value) {
+    return binary(BinaryOp::Sub, constant(value), constant(0));
+  }
+  std::pair<Value *, std::int32_t> binary(BinaryOp op,
+                                          std::pair<Value *, std::int32_t> lhs,
+                                          std::pair<Value *, std::int32_t> rhs) {
+    std::pair<Value *, std::int32_t> result = {
+        bb->Make<Binary>(true, op, lhs.first, rhs.first),
+        *eval_binary(op, lhs.second, rhs.second)};
+    results.push_back(result);
+    return result;
+  }
+
+  // Returns a checksum of all results so far, which keeps all of them live
+  // until the end. Gives the value `main` should return.
+  std::int32_t finish() {
+    auto acc = constant(0);
+    for (auto result : std::vector(results)) {
+      acc = binary(BinaryOp::Add, binary(BinaryOp::Mul, acc, constant(31)),
+                   result);
+    }
+    bb->Make<Return>(true, acc.first);
+    func->basicblocks.push_back(std::move(bb));
+    prog.functions.push_back(std::move(func));
+    return acc.second;
+  }
+};
+
+// What each function of `prog` returns on the machine
+std::vector<std::int32_t> run(const Program &prog, Alloc alloc,
+                              unsigned jobs) {
+  RawProgramBuilder builder;
+  koopa_raw_program_t raw = builder.build(prog);
+  std::ostringstream sink;
+  std::unique_ptr<IRegisterAllocator> allocator;
+  if (alloc == Alloc::LinearScan) {
+    allocator = std::make_unique<LinearScanAllocator>();
+  } else {
+    allocator = std::make_unique<GraphColoringAllocator>();
+  }
+  CodeGenUnit gen(sink, std::move(allocator));
+  gen.set_jobs(jobs);
+  MProgram mprogram = gen.lower(raw);
+
+  std::vector<std::int32_t> results;
+  MirMachine machine;
+  for (const MFunction &func : mprogram.functions) {
+    results.push_back(machine.run(func));
+  }
+  return results;
+}
+
+void check_program(const Program &prog,
+                   const std::vector<std::int32_t> &expected,
+                   const std::string &what, unsigned jobs = 1) {
+  for (Alloc alloc : {Alloc::LinearScan, Alloc::GraphColoring}) {
+    try {
+      std::vector<std::int32_t> results = run(prog, alloc, jobs);
+      CHECK(results == expected) << what << ", " << name(alloc) << "\n";
+    } catch (const std::exception &e) {
+      CHECK(false) << what << ", " << name(alloc) << ": " << e.what() << "\n";
+    }
+  }
+}
+
+// `op` on every register value with constant `c` on either side and in a
+// register, all in one function
+void test_operator(BinaryOp op, const char *op_name, std::int32_t c) {
+  bool divides = op == BinaryOp::Div || op == BinaryOp::Mod;
+  Program prog;
+  FunctionBuilder f(prog, "@main");
+  for (std::int32_t x : VALUES) {
+    auto lhs = f.reg(x);
+    if (!divides || c != 0) {
+      f.binary(op, lhs, f.constant(c));
+      f.binary(op, lhs, f.reg(c));
+    }
+    if (!divides || x != 0) {
+      f.binary(op, f.constant(c), lhs);
+    }
+  }
+  check_program(prog, {f.finish()}, std::string(op_name) + " with " +
+                                        std::to_string(c));
+}
+
+// More live values than registers, in a frame too large for 12-bit offsets
+void test_large_frame() {
+  Program prog;
+  FunctionBuilder f(prog, "@main");
+  for (int i = 0; i < 700; i++) {
+    f.reg(i * 7919 - 2000000);
+  }
+  check_program(prog, {f.finish()}, "700 live values");
+}
+
+// Random programs of several functions, lowered in parallel
+void test_random(unsigned seed) {
+  std::mt19937 rng(seed);
+  auto random_constant = [&]() -> std::int32_t {
+    switch (rng() % 4) {
+    case 0:
+      return CONSTANTS[rng() % CONSTANTS.size()];
+    case 1:
+      return static_cast<std::int32_t>(rng() % 4096) - 2048;
+    case 2:
+      return static_cast<std::int32_t>(rng() % 32);
+    default:
+      return static_cast<std::int32_t>(rng());
+    }
+  };
+
+  Program prog;
+  std::vector<std::int32_t> expected;
+  for (int i = 0; i < 6; i++) {
+    FunctionBuilder f(prog, i == 0 ? "@main" : "@f" + std::to_string(i));
+    std::vector<std::pair<Value *, std::int32_t>> values;
+    auto operand = [&] {
+      if (values.empty() || rng() % 3 == 0) {
+        return f.constant(random_constant());
+      }
+      return values[rng() % values.size()];
+    };
+    for (int j = 0; j < 60; j++) {
+      BinaryOp op = OPS[rng() % std::size(OPS)].first;
+      auto lhs = operand();
+      auto rhs = operand();
+      if (!eval_binary(op, lhs.second, rhs.second)) {
+        rhs = f.constant(7);
+      }
+      values.push_back(f.binary(op, lhs, rhs));
+    }
+    expected.push_back(f.finish());
+  }
+  check_program(prog, expected, "random program " + std::to_string(seed), 4);
+}
+
+} // namespace
+
+int main() {
+  for (const auto &[op, op_name] : OPS) {
+    for (std::int32_t c : CONSTANTS) {
+      test_operator(op, op_name, c);
+    }
+  }
+  test_large_frame();
+  for (unsigned seed = 1; seed <= 50; seed++) {
+    test_random(seed);
+  }
+  return test_status();
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Checks that a unary and parenthesis chain about a million levels deep
+# compiles with `-koopa` and dumps with `-dump-ast` under a 1 MiB stack, so
+# parsing, translation, dumping and destruction all keep their stacks on the
+# heap.
+# usage: deep_nesting.sh compiler [depth]
+set -e
+compiler=$1
+depth=${2:-1000000}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# `-(+(!(-(...(1)...))))`, one operator and one parenthesis per level
+awk -v depth="$depth" 'BEGIN {
+  printf "int main() {\n  return "
+  for (i = 0; i < depth; i++) printf "%s(", substr("-+!", i % 3 + 1, 1)
+  printf "1"
+  for (i = 0; i < depth; i++) printf ")"
+  printf ";\n}\n"
+}' > "$tmp/deep.c"
+
+ulimit -s 1024
+for dump in -dump-ast -dump-ast=json; do
+  if ! "$compiler" -koopa "$tmp/deep.c" -o "$tmp/deep.koopa" \
+       $dump -dump-ast-o "$tmp/deep.ast"; then
+    echo "deep_nesting: $depth levels failed with $dump" >&2
+    exit 1
+  fi
+  if ! grep -q ret "$tmp/deep.koopa" || [ ! -s "$tmp/deep.ast" ]; then
+    echo "deep_nesting: $depth levels gave no output with $dump" >&2
+    exit 1
+  fi
+done
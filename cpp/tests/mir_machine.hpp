@@ -0,0 +1,170 @@
+#pragma once
+
+#include "mir.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Runs machine IR on a model of an RV32IM hart, so the tests can check what
+// the backend generates without an assembler or a simulator. Besides the
+// result it checks the calling convention: `sp` and the callee-saved
+// registers must be as they were on entry.
+class MirMachine {
+private:
+  std::uint32_t regs[32] = {};
+  std::vector<std::uint8_t> memory;
+
+  static constexpr std::uint64_t STEP_LIMIT = 10'000'000;
+
+  [[noreturn]] static void fail(const MFunction &func, const std::string &msg) {
+    throw std::runtime_error(func.name + ": " + msg);
+  }
+
+  static bool is_callee_saved(unsigned x) {
+    return x == 8 || x == 9 || (x >= 18 && x <= 27);
+  }
+
+  std::uint32_t read(const MFunction &func, MReg reg) const {
+    if (reg.is_virtual()) {
+      fail(func, "virtual register v" + std::to_string(reg.index()));
+    }
+    return regs[reg.index()];
+  }
+
+  void write(const MFunction &func, MReg reg, std::uint32_t value) {
+    if (reg.is_virtual()) {
+      fail(func, "virtual register v" + std::to_string(reg.index()));
+    }
+    if (reg.index() != 0) {
+      regs[reg.index()] = value;
+    }
+  }
+
+  std::uint32_t address(const MFunction &func, const MInst &inst) const {
+    std::uint32_t addr =
+        read(func, inst.rs1) + static_cast<std::uint32_t>(inst.imm);
+    if (addr % 4 != 0 || addr > memory.size() - 4) {
+      fail(func, "bad memory access at " + std::to_string(addr));
+    }
+    return addr;
+  }
+
+public:
+  explicit MirMachine(std::size_t stack_bytes = 1 << 20)
+      : memory(stack_bytes) {}
+
+  // Value of `a0` when `func` returns
+  std::int32_t run(const MFunction &func) {
+    // Everything but `x0` and `sp` starts out as garbage
+    for (unsigned x = 1; x < 32; x++) {
+      regs[x] = 0x9e3779b9u * x;
+    }
+    regs[2] = static_cast<std::uint32_t>(memory.size());
+    std::uint32_t entry[32];
+    std::copy(regs, regs + 32, entry);
+
+    std::size_t pc = 0;
+    auto branch = [&](bool taken, const MInst &inst) {
+      if (!taken) {
+        pc++;
+        return;
+      }
+      if (inst.imm < 0 ||
+          static_cast<std::size_t>(inst.imm) >= func.blocks.size()) {
+        fail(func, "branch to block " + std::to_string(inst.imm));
+      }
+      pc = func.blocks[inst.imm].begin;
+    };
+
+    for (std::uint64_t steps = 0; steps < STEP_LIMIT; steps++) {
+      if (pc >= func.insts.size()) {
+        fail(func, "ran past the last instruction");
+      }
+      const MInst &inst = func.insts[pc];
+      std::uint32_t a = read(func, inst.rs1);
+      std::uint32_t b = read(func, inst.rs2);
+      auto sa = static_cast<std::int32_t>(a);
+      auto sb = static_cast<std::int32_t>(b);
+      auto imm = static_cast<std::uint32_t>(inst.imm);
+      std::uint32_t r = 0;
+
+      switch (inst.op) {
+      case MOp::ADD: r = a + b; break;
+      case MOp::SUB: r = a - b; break;
+      case MOp::MUL: r = a * b; break;
+      case MOp::MULH:
+        r = static_cast<std::uint32_t>(
+            (static_cast<std::int64_t>(sa) * static_cast<std::int64_t>(sb)) >>
+            32);
+        break;
+      case MOp::DIV:
+        r = b == 0 ? 0xffffffffu
+            : (sa == INT32_MIN && sb == -1)
+                ? a
+                : static_cast<std::uint32_t>(sa / sb);
+        break;
+      case MOp::REM:
+        r = b == 0 ? a
+            : (sa == INT32_MIN && sb == -1)
+                ? 0
+                : static_cast<std::uint32_t>(sa % sb);
+        break;
+      case MOp::AND: r = a & b; break;
+      case MOp::OR: r = a | b; break;
+      case MOp::XOR: r = a ^ b; break;
+      case MOp::SLL: r = a << (b & 31); break;
+      case MOp::SRL: r = a >> (b & 31); break;
+      case MOp::SRA: r = static_cast<std::uint32_t>(sa >> (b & 31)); break;
+      case MOp::SLT: r = sa < sb; break;
+      case MOp::ADDI: r = a + imm; break;
+      case MOp::ANDI: r = a & imm; break;
+      case MOp::ORI: r = a | imm; break;
+      case MOp::XORI: r = a ^ imm; break;
+      case MOp::SLLI: r = a << (imm & 31); break;
+      case MOp::SRLI: r = a >> (imm & 31); break;
+      case MOp::SRAI: r = static_cast<std::uint32_t>(sa >> (imm & 31)); break;
+      case MOp::SLTI: r = sa < inst.imm; break;
+      case MOp::MV: r = a; break;
+      case MOp::NEG: r = 0u - a; break;
+      case MOp::NOT: r = ~a; break;
+      case MOp::SEQZ: r = a == 0; break;
+      case MOp::SNEZ: r = a != 0; break;
+      case MOp::LI: r = imm; break;
+      case MOp::LUI: r = imm << 12; break;
+      case MOp::LW: {
+        std::uint32_t addr = address(func, inst);
+        for (int i = 3; i >= 0; i--) {
+          r = r << 8 | memory[addr + i];
+        }
+        break;
+      }
+      case MOp::SW: {
+        std::uint32_t addr = address(func, inst);
+        for (int i = 0; i < 4; i++) {
+          memory[addr + i] = static_cast<std::uint8_t>(b >> (8 * i));
+        }
+        pc++;
+        continue;
+      }
+      case MOp::BEQ: branch(a == b, inst); continue;
+      case MOp::BNE: branch(a != b, inst); continue;
+      case MOp::BLT: branch(sa < sb, inst); continue;
+      case MOp::BGE: branch(sa >= sb, inst); continue;
+      case MOp::BEQZ: branch(a == 0, inst); continue;
+      case MOp::BNEZ: branch(a != 0, inst); continue;
+      case MOp::J: branch(true, inst); continue;
+      case MOp::RET:
+        for (unsigned x = 1; x < 32; x++) {
+          if ((x == 2 || is_callee_saved(x)) && regs[x] != entry[x]) {
+            fail(func, "x" + std::to_string(x) + " not restored");
+          }
+        }
+        return static_cast<std::int32_t>(regs[10]);
+      }
+      write(func, inst.rd, r);
+      pc++;
+    }
+    fail(func, "step limit reached");
+  }
+};
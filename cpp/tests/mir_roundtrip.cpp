@@ -0,0 +1,177 @@
+// Writes a hand-built program that uses every opcode of the machine IR, as
+// assembly (`mir.S`) and as the object `-obj` would make of it (`mir.o`),
+// for mir_roundtrip.sh to compare with what an assembler makes of the
+// assembly. Immediates sit at the edges of their fields, registers run
+// through all 32, and branches go both forwards and backwards.
+// usage: mir_roundtrip output_dir
+
+#include "check.hpp"
+#include "elf_writer.hpp"
+#include "emitter.hpp"
+#include "mir.hpp"
+#include "riscv_encoder.hpp"
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t OP_COUNT = static_cast<std::size_t>(MOp::RET) + 1;
+
+// Registers for the next instructions, cycling through `x0`-`x31` at
+// different rates so every field sees every register
+class RegisterCycle {
+private:
+  unsigned next = 0;
+
+public:
+  MReg operator()() {
+    MReg reg = MReg::phys(next);
+    next = (next + 7) % 32;
+    return reg;
+  }
+};
+
+// Immediates worth encoding for `op`
+std::vector<std::int32_t> immediates(MOp op) {
+  switch (op) {
+  case MOp::SLLI:
+  case MOp::SRLI:
+  case MOp::SRAI:
+    return {0, 1, 17, 31};
+  case MOp::LI:
+    return {0,          1,          -1,         2047,      -2048,
+            2048,       -2049,      0x12345000, 0x12345678, 0x7ffff800,
+            0x7fffffff, INT32_MIN,  -0x12345679};
+  case MOp::LUI:
+    return {0, 1, 0x7ffff, 0x80000, 0xfffff};
+  case MOp::LW:
+  case MOp::SW:
+    return {-2048, -4, 0, 4, 2044};
+  default:
+    return {-2048, -1, 0, 1, 0x555, 2047};
+  }
+}
+
+// The instructions of every non-control opcode
+std::vector<MInst> straight_line(RegisterCycle &reg) {
+  std::vector<MInst> insts;
+  for (std::size_t i = 0; i < OP_COUNT; i++) {
+    auto op = static_cast<MOp>(i);
+    switch (info(op).format) {
+    case MFormat::R:
+      for (int n = 0; n < 4; n++) {
+        insts.push_back(MInst{op, reg(), reg(), reg()});
+      }
+      break;
+    case MFormat::Unary:
+      for (int n = 0; n < 4; n++) {
+        insts.push_back(MInst{op, reg(), reg()});
+      }
+      break;
+    case MFormat::I:
+    case MFormat::Load:
+      for (std::int32_t imm : immediates(op)) {
+        insts.push_back(MInst{op, reg(), reg(), MREG_ZERO, imm});
+      }
+      break;
+    case MFormat::Imm:
+      for (std::int32_t imm : immediates(op)) {
+        insts.push_back(MInst{op, reg(), MREG_ZERO, MREG_ZERO, imm});
+      }
+      break;
+    case MFormat::Store:
+      for (std::int32_t imm : immediates(op)) {
+        insts.push_back(MInst{op, MREG_ZERO, reg(), reg(), imm});
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return insts;
+}
+
+// Blocks: the prologue, the straight-line code, one block per branch
+// opcode, and the epilogue. Branches alternate between the first body block
+// and the epilogue.
+MFunction make_function(const std::string &name, RegisterCycle &reg) {
+  std::vector<std::vector<MInst>> blocks;
+  blocks.push_back({MInst{MOp::ADDI, MREG_SP, MREG_SP, MREG_ZERO, -16}});
+  blocks.push_back(straight_line(reg));
+  for (std::size_t i = 0; i < OP_COUNT; i++) {
+    auto op = static_cast<MOp>(i);
+    MFormat format = info(op).format;
+    if (format != MFormat::Branch && format != MFormat::BranchZ &&
+        format != MFormat::Jump) {
+      continue;
+    }
+    for (bool forward : {true, false}) {
+      // The epilogue comes after the blocks of the remaining branches
+      std::int32_t target = forward ? -1 : 1;
+      MInst branch{op, MREG_ZERO, MREG_ZERO, MREG_ZERO, target};
+      if (format != MFormat::Jump) {
+        branch.rs1 = reg();
+      }
+      if (format == MFormat::Branch) {
+        branch.rs2 = reg();
+      }
+      blocks.push_back({MInst{MOp::ADDI, reg(), reg(), MREG_ZERO, 1}, branch});
+    }
+  }
+  blocks.push_back({MInst{MOp::ADDI, MREG_SP, MREG_SP, MREG_ZERO, 16},
+                    MInst{MOp::RET}});
+
+  MFunction func;
+  func.name = name;
+  auto epilogue = static_cast<std::int32_t>(blocks.size() - 1);
+  for (auto &block : blocks) {
+    auto begin = static_cast<std::uint32_t>(func.insts.size());
+    for (MInst inst : block) {
+      if (inst.is_terminator() && inst.imm == -1) {
+        inst.imm = epilogue;
+      }
+      func.insts.push_back(inst);
+    }
+    func.blocks.push_back(
+        {begin, static_cast<std::uint32_t>(func.insts.size())});
+  }
+  return func;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " output_dir\n";
+    return 1;
+  }
+  std::string dir = argv[1];
+
+  // `main` first, then a local function that starts past offset 0
+  MProgram program;
+  RegisterCycle reg;
+  program.functions.push_back(make_function("main", reg));
+  program.functions.push_back(make_function("f", reg));
+
+  bool used[OP_COUNT] = {};
+  for (const MFunction &func : program.functions) {
+    for (const MInst &inst : func.insts) {
+      used[static_cast<std::size_t>(inst.op)] = true;
+    }
+  }
+  for (std::size_t i = 0; i < OP_COUNT; i++) {
+    CHECK(used[i]) << info(static_cast<MOp>(i)).mnemonic << " not covered\n";
+  }
+
+  std::ofstream assembly(dir + "/mir.S");
+  Emitter out(assembly);
+  program.print(out);
+  out.flush();
+  std::ofstream object(dir + "/mir.o", std::ios::binary);
+  write_elf_object(encode_program(program), object);
+  CHECK(assembly && object) << "cannot write to " << dir << "\n";
+  return test_status();
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Checks that the encoder makes of hand-built machine IR, every opcode
+# included, the same machine code an assembler makes of its assembly.
+# usage: mir_roundtrip.sh mir_roundtrip llvm-mc llvm-objcopy
+set -e
+test=$1
+mc=$2
+objcopy=$3
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+"$test" "$tmp"
+"$mc" -triple=riscv32 -mattr=+m -filetype=obj "$tmp/mir.S" -o "$tmp/ref.o"
+"$objcopy" -O binary --only-section=.text "$tmp/mir.o" "$tmp/out.bin"
+"$objcopy" -O binary --only-section=.text "$tmp/ref.o" "$tmp/ref.bin"
+if ! cmp "$tmp/out.bin" "$tmp/ref.bin"; then
+  echo "machine IR encodes differently from its assembled text" >&2
+  exit 1
+fi
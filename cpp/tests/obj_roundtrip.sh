@@ -0,0 +1,24 @@
+#!/bin/sh
+# Checks that `-obj` encodes the same machine code an assembler makes of the
+# `-riscv` output of a source, with and without `-O2`.
+# usage: obj_roundtrip.sh compiler llvm-mc llvm-objcopy source
+set -e
+compiler=$1
+mc=$2
+objcopy=$3
+source=$4
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for opt in -O0 -O2; do
+  "$compiler" -riscv "$source" -o "$tmp/out.S" $opt
+  "$compiler" -obj "$source" -o "$tmp/out.o" $opt
+  "$mc" -triple=riscv32 -mattr=+m -filetype=obj "$tmp/out.S" -o "$tmp/ref.o"
+  "$objcopy" -O binary --only-section=.text "$tmp/out.o" "$tmp/out.bin"
+  "$objcopy" -O binary --only-section=.text "$tmp/ref.o" "$tmp/ref.bin"
+  if ! cmp "$tmp/out.bin" "$tmp/ref.bin"; then
+    echo "$source ($opt): -obj differs from the assembled -riscv output" >&2
+    exit 1
+  fi
+done
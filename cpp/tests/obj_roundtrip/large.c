@@ -0,0 +1,4 @@
+// Needs `lui` + `addi`
+int main() {
+  return 305419896;
+}
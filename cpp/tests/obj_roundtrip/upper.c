@@ -0,0 +1,4 @@
+// The lower 12 bits are zero, so `lui` alone
+int main() {
+  return -0x12345000;
+}
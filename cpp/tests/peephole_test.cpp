@@ -0,0 +1,256 @@
+// Runs the peephole optimiser on hand-written functions and compares the
+// instructions it leaves with the expected ones. Every rule has a case where
+// it applies and cases where it must not: the register it would drop is
+// read later, is not one of the block-local scratch registers, or lives on
+// in another block.
+
+#include "check.hpp"
+#include "emitter.hpp"
+#include "mir.hpp"
+#include "peephole.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Blocks = std::vector<std::vector<MInst>>;
+
+constexpr MReg T0 = MReg::phys(5);
+constexpr MReg T5 = MReg::phys(30);
+constexpr MReg T6 = MReg::phys(31);
+constexpr MReg S1 = MReg::phys(9);
+constexpr MReg S2 = MReg::phys(18);
+constexpr MReg S3 = MReg::phys(19);
+constexpr MReg A0 = MREG_A0;
+
+MInst r(MOp op, MReg rd, MReg rs1, MReg rs2) { return {op, rd, rs1, rs2}; }
+MInst i(MOp op, MReg rd, MReg rs1, std::int32_t imm) {
+  return {op, rd, rs1, MREG_ZERO, imm};
+}
+MInst unary(MOp op, MReg rd, MReg rs1) { return {op, rd, rs1}; }
+MInst li(MReg rd, std::int32_t imm) { return {MOp::LI, rd, {}, {}, imm}; }
+MInst lui(MReg rd, std::int32_t imm) { return {MOp::LUI, rd, {}, {}, imm}; }
+MInst sw(MReg rs2, std::int32_t offset) {
+  return {MOp::SW, MREG_ZERO, MREG_SP, rs2, offset};
+}
+MInst branch(MOp op, MReg rs1, std::int32_t block) {
+  return {op, MREG_ZERO, rs1, MREG_ZERO, block};
+}
+MInst branch(MOp op, MReg rs1, MReg rs2, std::int32_t block) {
+  return {op, MREG_ZERO, rs1, rs2, block};
+}
+MInst j(std::int32_t block) { return {MOp::J, {}, {}, {}, block}; }
+MInst ret() { return {MOp::RET}; }
+
+MFunction make_function(const Blocks &blocks) {
+  MFunction func;
+  func.name = "f";
+  for (const auto &block : blocks) {
+    auto begin = static_cast<std::uint32_t>(func.insts.size());
+    func.insts.insert(func.insts.end(), block.begin(), block.end());
+    func.blocks.push_back({begin, static_cast<std::uint32_t>(func.insts.size())});
+  }
+  return func;
+}
+
+std::string text(const MFunction &func) {
+  Emitter out;
+  func.print(out);
+  return out.take();
+}
+
+void check_peephole(const std::string &what, const Blocks &before,
+                    const Blocks &after) {
+  const MFunction original = make_function(before);
+  const MFunction expected = make_function(after);
+  MFunction func = original;
+  std::size_t removed = run_peephole(func);
+  CHECK(text(func) == text(expected))
+      << what << "\n"
+      << text(original) << "became\n"
+      << text(func) << "instead of\n"
+      << text(expected);
+  CHECK(removed == original.insts.size() - expected.insts.size())
+      << what << ": " << removed << " removed\n";
+}
+
+void check_unchanged(const std::string &what, const Blocks &blocks) {
+  check_peephole(what, blocks, blocks);
+}
+
+void test_identity_to_move() {
+  const MInst identities[] = {
+      i(MOp::ADDI, S2, S1, 0),       i(MOp::ORI, S2, S1, 0),
+      i(MOp::XORI, S2, S1, 0),       i(MOp::SLLI, S2, S1, 0),
+      i(MOp::SRLI, S2, S1, 0),       i(MOp::SRAI, S2, S1, 0),
+      i(MOp::ANDI, S2, S1, -1),      r(MOp::ADD, S2, S1, MREG_ZERO),
+      r(MOp::ADD, S2, MREG_ZERO, S1), r(MOp::OR, S2, S1, MREG_ZERO),
+      r(MOp::OR, S2, MREG_ZERO, S1), r(MOp::XOR, S2, S1, MREG_ZERO),
+      r(MOp::XOR, S2, MREG_ZERO, S1), r(MOp::SUB, S2, S1, MREG_ZERO),
+      r(MOp::SLL, S2, S1, MREG_ZERO), r(MOp::SRL, S2, S1, MREG_ZERO),
+      r(MOp::SRA, S2, S1, MREG_ZERO),
+  };
+  for (const MInst &inst : identities) {
+    check_peephole("identity " + std::string(info(inst.op).mnemonic),
+                   {{inst, ret()}}, {{unary(MOp::MV, S2, S1), ret()}});
+  }
+  check_unchanged("sub from x0", {{r(MOp::SUB, S2, MREG_ZERO, S1), ret()}});
+  check_unchanged("addi 1", {{i(MOp::ADDI, S2, S1, 1), ret()}});
+  check_unchanged("andi 0", {{i(MOp::ANDI, S2, S1, 0), ret()}});
+}
+
+void test_self_move() {
+  check_peephole("self move", {{unary(MOp::MV, S1, S1), ret()}}, {{ret()}});
+}
+
+void test_self_xor() {
+  check_peephole("xor with itself", {{r(MOp::XOR, S2, S1, S1), ret()}},
+                 {{li(S2, 0), ret()}});
+  check_peephole("sub from itself", {{r(MOp::SUB, S2, S1, S1), ret()}},
+                 {{li(S2, 0), ret()}});
+  check_peephole("slt with itself", {{r(MOp::SLT, S2, S1, S1), ret()}},
+                 {{li(S2, 0), ret()}});
+  check_peephole("seqz x0", {{unary(MOp::SEQZ, S2, MREG_ZERO), ret()}},
+                 {{li(S2, 1), ret()}});
+  check_peephole("snez x0", {{unary(MOp::SNEZ, S2, MREG_ZERO), ret()}},
+                 {{li(S2, 0), ret()}});
+  check_unchanged("xor", {{r(MOp::XOR, S2, S1, S3), ret()}});
+}
+
+void test_forward_copy() {
+  check_peephole("forward copy",
+                 {{unary(MOp::MV, T0, S1), r(MOp::ADD, S2, T0, S3), ret()}},
+                 {{r(MOp::ADD, S2, S1, S3), ret()}});
+  // `li t0, 0` is a move from `x0`, and the `add` is then an identity
+  check_peephole("forward zero",
+                 {{li(T0, 0), r(MOp::ADD, S2, S3, T0), ret()}},
+                 {{unary(MOp::MV, S2, S3), ret()}});
+  check_peephole("forward copy of a scratch register",
+                 {{unary(MOp::MV, T5, S1), r(MOp::ADD, S2, T5, S3), j(2)},
+                  {ret()}},
+                 {{r(MOp::ADD, S2, S1, S3), j(2)}, {ret()}});
+
+  check_unchanged("forward copy read twice",
+                  {{unary(MOp::MV, T0, S1), r(MOp::ADD, S2, T0, S3),
+                    r(MOp::ADD, S3, T0, S2), ret()}});
+  check_unchanged("forward copy of a register live at return",
+                  {{unary(MOp::MV, A0, S1), r(MOp::ADD, S2, A0, S3), ret()}});
+  check_unchanged("forward copy across blocks",
+                  {{unary(MOp::MV, T0, S1), r(MOp::ADD, S2, T0, S3), j(2)},
+                   {r(MOp::ADD, A0, T0, S2), ret()}});
+}
+
+void test_backward_copy() {
+  check_peephole("backward copy",
+                 {{r(MOp::ADD, T0, S1, S2), unary(MOp::MV, A0, T0), ret()}},
+                 {{r(MOp::ADD, A0, S1, S2), ret()}});
+  check_peephole("backward copy of a scratch register",
+                 {{r(MOp::ADD, T6, S1, S2), unary(MOp::MV, A0, T6), j(2)},
+                  {ret()}},
+                 {{r(MOp::ADD, A0, S1, S2), j(2)}, {ret()}});
+
+  check_unchanged("backward copy read again",
+                  {{r(MOp::ADD, T0, S1, S2), unary(MOp::MV, A0, T0), sw(T0, 0),
+                    ret()}});
+  check_unchanged("backward copy of a register live at return",
+                  {{r(MOp::ADD, S3, S1, S2), unary(MOp::MV, A0, S3), ret()}});
+  check_unchanged("backward copy across blocks",
+                  {{r(MOp::ADD, T0, S1, S2), unary(MOp::MV, A0, T0), j(2)},
+                   {r(MOp::ADD, A0, A0, T0), ret()}});
+}
+
+void test_fuse_compare_branch() {
+  struct Fusion {
+    MOp compare;
+    MOp branch;
+    MOp fused;
+  };
+  const Fusion fusions[] = {
+      {MOp::SLT, MOp::BNEZ, MOp::BLT},   {MOp::SLT, MOp::BEQZ, MOp::BGE},
+      {MOp::XOR, MOp::BNEZ, MOp::BNE},   {MOp::XOR, MOp::BEQZ, MOp::BEQ},
+      {MOp::SUB, MOp::BNEZ, MOp::BNE},   {MOp::SUB, MOp::BEQZ, MOp::BEQ},
+      {MOp::SEQZ, MOp::BNEZ, MOp::BEQZ}, {MOp::SEQZ, MOp::BEQZ, MOp::BNEZ},
+      {MOp::SNEZ, MOp::BNEZ, MOp::BNEZ}, {MOp::SNEZ, MOp::BEQZ, MOp::BEQZ},
+  };
+  const std::vector<MInst> targets[] = {{li(A0, 0), ret()},
+                                        {li(A0, 1), ret()}};
+  for (const Fusion &fusion : fusions) {
+    bool unary_compare = info(fusion.compare).format == MFormat::Unary;
+    auto compare = [&](MReg rd) {
+      return unary_compare ? unary(fusion.compare, rd, S1)
+                           : r(fusion.compare, rd, S1, S2);
+    };
+    MInst fused = unary_compare ? branch(fusion.fused, S1, 3)
+                                : branch(fusion.fused, S1, S2, 3);
+    std::string what = std::string(info(fusion.compare).mnemonic) + " + " +
+                       std::string(info(fusion.branch).mnemonic);
+
+    check_peephole(what,
+                   {{compare(T5), branch(fusion.branch, T5, 3)},
+                    targets[0],
+                    targets[1]},
+                   {{fused}, targets[0], targets[1]});
+    check_unchanged(what + " into a non-scratch register",
+                    {{compare(T0), branch(fusion.branch, T0, 3)},
+                     targets[0],
+                     targets[1]});
+  }
+
+  check_unchanged("compare also moved elsewhere",
+                  {{r(MOp::SLT, T5, S1, S2), unary(MOp::MV, S3, T5),
+                    branch(MOp::BNEZ, T5, 3)},
+                   targets[0],
+                   targets[1]});
+  check_unchanged("branch on another register",
+                  {{r(MOp::SLT, T5, S1, S2), branch(MOp::BNEZ, T6, 3)},
+                   targets[0],
+                   targets[1]});
+  check_unchanged("compare and branch in different blocks",
+                  {{r(MOp::SLT, T5, S1, S2)},
+                   {branch(MOp::BNEZ, T5, 3)},
+                   targets[0],
+                   targets[1]});
+}
+
+void test_forward_constants() {
+  check_peephole("constant already held",
+                 {{li(T5, 100), r(MOp::ADD, S1, S1, T5), li(T5, 100),
+                   r(MOp::ADD, S2, S2, T5), ret()}},
+                 {{li(T5, 100), r(MOp::ADD, S1, S1, T5),
+                   r(MOp::ADD, S2, S2, T5), ret()}});
+  // The move that replaces `lui` + `addi` is then forwarded into the `add`
+  check_peephole("constant held by another register",
+                 {{lui(T5, 0x12345), i(MOp::ADDI, T5, T5, 0x678),
+                   r(MOp::ADD, S1, S1, T5), lui(T6, 0x12345),
+                   i(MOp::ADDI, T6, T6, 0x678), r(MOp::ADD, S2, S2, T6),
+                   ret()}},
+                 {{lui(T5, 0x12345), i(MOp::ADDI, T5, T5, 0x678),
+                   r(MOp::ADD, S1, S1, T5), r(MOp::ADD, S2, S2, T5),
+                   ret()}});
+
+  check_unchanged("constant overwritten",
+                  {{li(T5, 100), r(MOp::ADD, T5, S1, T5), li(T5, 100),
+                    r(MOp::ADD, S2, S2, T5), ret()}});
+  check_unchanged("constant from another block",
+                  {{li(T5, 100), r(MOp::ADD, S1, S1, T5), j(2)},
+                   {li(T5, 100), r(MOp::ADD, S2, S2, T5), ret()}});
+  check_unchanged("different constant",
+                  {{lui(T5, 0x12345), i(MOp::ADDI, T5, T5, 0x678),
+                    r(MOp::ADD, S1, S1, T5), lui(T6, 0x12345),
+                    i(MOp::ADDI, T6, T6, 0x679), r(MOp::ADD, S2, S2, T6),
+                    ret()}});
+}
+
+} // namespace
+
+int main() {
+  test_identity_to_move();
+  test_self_move();
+  test_self_xor();
+  test_forward_copy();
+  test_backward_copy();
+  test_fuse_compare_branch();
+  test_forward_constants();
+  return test_status();
+}